@@ -0,0 +1,53 @@
+TEMPLATE = app
+TARGET = modbusbenchmark
+
+QT -= gui
+QT += \
+    network \
+    serialbus \
+    serialport \
+
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+# The plugin sources are compiled in directly, extern-plugininfo.h is taken from this directory
+INCLUDEPATH += $$PWD $$PWD/..
+
+SOURCES += \
+    main.cpp \
+    simulatedslave.cpp \
+    modbustcpsimulator.cpp \
+    modbusrtusimulator.cpp \
+    pollbenchmark.cpp \
+    ../modbustcpmaster.cpp \
+    ../modbusrtumaster.cpp \
+    ../modbusrequesttable.cpp \
+    ../modbustransactionqueue.cpp \
+    ../modbusstatistics.cpp \
+    ../roundtripestimator.cpp \
+    ../pollplanner.cpp \
+    ../pollcyclemonitor.cpp \
+    ../pollscheduler.cpp \
+    ../modbuswritecoalescer.cpp \
+    ../reconnectpolicy.cpp \
+    ../circuitbreaker.cpp \
+
+HEADERS += \
+    extern-plugininfo.h \
+    simulatedslave.h \
+    modbustcpsimulator.h \
+    modbusrtusimulator.h \
+    pollbenchmark.h \
+    ../modbustcpmaster.h \
+    ../modbusrtumaster.h \
+    ../modbusrequesttable.h \
+    ../modbustransactionqueue.h \
+    ../modbusstatistics.h \
+    ../roundtripestimator.h \
+    ../pollplanner.h \
+    ../pollcyclemonitor.h \
+    ../pollscheduler.h \
+    ../modbuswritecoalescer.h \
+    ../reconnectpolicy.h \
+    ../circuitbreaker.h \
+    ../modbusmasterstatus.h \
@@ -0,0 +1,237 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QThread>
+#include <QTimer>
+#include <QUuid>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+#include "extern-plugininfo.h"
+#include "modbustcpmaster.h"
+#include "modbusrtumaster.h"
+#include "modbustcpsimulator.h"
+#include "modbusrtusimulator.h"
+#include "pollbenchmark.h"
+
+Q_LOGGING_CATEGORY(dcModbusCommander, "ModbusCommander")
+
+static void benchmarkRequestIds(int iterations, QTextStream &stream)
+{
+    // Compares the former QUuid keyed request bookkeeping with the monotonic id table,
+    // each iteration creates an id, stores the devices of the request and takes them back
+    QList<Device *> devices;
+    devices.append(reinterpret_cast<Device *>(static_cast<quintptr>(1)));
+
+    QElapsedTimer timer;
+    QHash<QUuid, QList<Device *> > uuidRequests;
+    timer.start();
+    for (int i = 0; i < iterations; i++) {
+        QUuid requestId = QUuid::createUuid();
+        uuidRequests.insert(requestId, devices);
+        uuidRequests.take(requestId);
+    }
+    qint64 uuidTime = timer.nsecsElapsed();
+
+    ModbusRequestTable<QList<Device *> > tableRequests;
+    timer.restart();
+    for (int i = 0; i < iterations; i++) {
+        ModbusRequestId requestId = createModbusRequestId();
+        tableRequests.insert(requestId, devices);
+        tableRequests.take(requestId);
+    }
+    qint64 tableTime = timer.nsecsElapsed();
+
+    stream << "QUuid + QHash:          " << QString::number(static_cast<double>(uuidTime) / iterations, 'f', 1) << " ns/request" << endl;
+    stream << "request id + table:     " << QString::number(static_cast<double>(tableTime) / iterations, 'f', 1) << " ns/request" << endl;
+}
+
+static void setupBenchmark(PollBenchmark &benchmark, const QCommandLineParser &parser)
+{
+    benchmark.setPoints(parser.value("points").toUInt(), parser.value("slaves").toUInt(), QModbusDataUnit::HoldingRegisters);
+    benchmark.setBlockLimits(parser.value("max-gap").toUInt(), parser.value("max-block").toUInt());
+    benchmark.setPollInterval(parser.value("interval").toUInt());
+}
+
+static void printStatistics(QTextStream &stream, const ModbusStatistics &statistics, uint busUtilization)
+{
+    stream << "round trip p50/p99: " << statistics.roundTripTimePercentile(50) << " / " << statistics.roundTripTimePercentile(99) << " ms" << endl;
+    stream << "bus utilization:    " << busUtilization << " %" << endl;
+    stream << "timeouts:           " << statistics.timeouts() << endl;
+    stream << "exceptions:         " << statistics.exceptionResponses() << endl;
+}
+
+static int runTcpBenchmark(QCoreApplication &application, const QCommandLineParser &parser, QTextStream &stream)
+{
+    // The simulator gets its own thread, so the cpu time of the master thread is not mixed up with it
+    QThread simulatorThread;
+    ModbusTcpSimulator *simulator = nullptr;
+    quint16 port = static_cast<quint16>(parser.value("port").toUInt());
+    if (!parser.isSet("port")) {
+        simulator = new ModbusTcpSimulator();
+        simulator->setLatency(parser.value("latency").toUInt());
+        simulator->setRegisterCount(parser.value("registers").toUInt());
+        simulator->setExceptionRate(parser.value("exception-rate").toDouble());
+        simulator->setDropRate(parser.value("drop-rate").toDouble());
+        simulator->moveToThread(&simulatorThread);
+        QObject::connect(&simulatorThread, &QThread::finished, simulator, &QObject::deleteLater);
+        simulatorThread.start();
+
+        bool listening = false;
+        QMetaObject::invokeMethod(simulator, "listen", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, listening), Q_ARG(quint16, 0));
+        QMetaObject::invokeMethod(simulator, "serverPort", Qt::BlockingQueuedConnection, Q_RETURN_ARG(quint16, port));
+        if (!listening) {
+            stream << "Could not start the simulator" << endl;
+            simulatorThread.quit();
+            simulatorThread.wait();
+            return 1;
+        }
+    }
+
+    ModbusTCPMaster master("127.0.0.1", port, parser.value("pool").toInt());
+    master.setMaxInFlight(parser.value("in-flight").toInt());
+    master.setQueueDepth(100000);
+
+    PollBenchmark benchmark(&master);
+    setupBenchmark(benchmark, parser);
+
+    // Start once the connection accepts requests
+    QTimer startTimer;
+    startTimer.setInterval(10);
+    QObject::connect(&startTimer, &QTimer::timeout, [&] {
+        if (master.pendingRequests() == 0 && master.readHoldingRegister(1, 0) != 0) {
+            startTimer.stop();
+            master.resetStatistics();
+            benchmark.start(parser.value("duration").toUInt());
+        }
+    });
+    QObject::connect(&benchmark, &PollBenchmark::finished, [&] {
+        benchmark.printResults(stream);
+        printStatistics(stream, master.statistics(), master.busUtilization());
+        application.quit();
+    });
+    master.connectDevice();
+    startTimer.start();
+
+    int result = application.exec();
+    simulatorThread.quit();
+    simulatorThread.wait();
+    return result;
+}
+
+static int runRtuBenchmark(QCoreApplication &application, const QCommandLineParser &parser, QTextStream &stream)
+{
+    QThread simulatorThread;
+    ModbusRtuSimulator *simulator = new ModbusRtuSimulator();
+    simulator->setBaudRate(parser.value("baud").toUInt());
+    simulator->setTurnaround(parser.value("turnaround").toUInt());
+    simulator->setSlaves(1, parser.value("slaves").toUInt(), parser.value("dead-slaves").toUInt());
+    simulator->setRegisterCount(parser.value("registers").toUInt());
+    simulator->moveToThread(&simulatorThread);
+    QObject::connect(&simulatorThread, &QThread::finished, simulator, &QObject::deleteLater);
+    simulatorThread.start();
+
+    QString serialPort;
+    QMetaObject::invokeMethod(simulator, "open", Qt::BlockingQueuedConnection, Q_RETURN_ARG(QString, serialPort));
+    if (serialPort.isEmpty()) {
+        stream << "Could not open a pseudo terminal" << endl;
+        simulatorThread.quit();
+        simulatorThread.wait();
+        return 1;
+    }
+
+    ModbusRTUMaster master(serialPort, parser.value("baud").toUInt(), QSerialPort::NoParity, 8, 1);
+    master.setQueueDepth(100000);
+
+    PollBenchmark benchmark(&master);
+    setupBenchmark(benchmark, parser);
+
+    QTimer startTimer;
+    startTimer.setInterval(10);
+    QObject::connect(&startTimer, &QTimer::timeout, [&] {
+        if (master.pendingRequests() == 0 && master.readHoldingRegister(1, 0) != 0) {
+            startTimer.stop();
+            master.resetStatistics();
+            benchmark.start(parser.value("duration").toUInt());
+        }
+    });
+    QObject::connect(&benchmark, &PollBenchmark::finished, [&] {
+        stream << "serial port:        " << serialPort << " at " << parser.value("baud") << " baud" << endl;
+        benchmark.printResults(stream);
+        printStatistics(stream, master.statistics(), master.busUtilization());
+        application.quit();
+    });
+    master.connectDevice();
+    startTimer.start();
+
+    int result = application.exec();
+    simulatorThread.quit();
+    simulatorThread.wait();
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+    QCoreApplication::setApplicationName("modbusbenchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Polling throughput benchmark for the modbus commander plugin");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("points", "Number of simulated child points.", "count", "1000"));
+    parser.addOption(QCommandLineOption("slaves", "Number of slaves the points are spread over.", "count", "1"));
+    parser.addOption(QCommandLineOption("interval", "Poll interval of every point in ms.", "ms", "1000"));
+    parser.addOption(QCommandLineOption("duration", "Benchmark duration in ms.", "ms", "10000"));
+    parser.addOption(QCommandLineOption("max-gap", "Maximum register gap merged into one block.", "registers", "0"));
+    parser.addOption(QCommandLineOption("max-block", "Maximum block size.", "registers", "125"));
+    parser.addOption(QCommandLineOption("in-flight", "Maximum concurrent requests per connection.", "count", "4"));
+    parser.addOption(QCommandLineOption("pool", "Connections per endpoint.", "count", "1"));
+    parser.addOption(QCommandLineOption("latency", "Simulated response latency in ms.", "ms", "0"));
+    parser.addOption(QCommandLineOption("registers", "Number of registers of the simulated slave.", "count", "10000"));
+    parser.addOption(QCommandLineOption("exception-rate", "Share of requests answered with an exception.", "rate", "0"));
+    parser.addOption(QCommandLineOption("drop-rate", "Share of requests left unanswered.", "rate", "0"));
+    parser.addOption(QCommandLineOption("rtu", "Benchmark the RTU master over a pseudo terminal pair instead of TCP."));
+    parser.addOption(QCommandLineOption("baud", "Simulated baud rate of the RTU line.", "baud", "9600"));
+    parser.addOption(QCommandLineOption("turnaround", "Turnaround time of the simulated RTU slaves in ms.", "ms", "5"));
+    parser.addOption(QCommandLineOption("dead-slaves", "Number of simulated RTU slaves that never answer.", "count", "0"));
+    parser.addOption(QCommandLineOption("port", "Benchmark an external Modbus TCP server on localhost instead of the simulator.", "port"));
+    parser.addOption(QCommandLineOption("request-ids", "Only measure the request id bookkeeping with the given number of iterations.", "iterations"));
+    parser.addOption(QCommandLineOption("verbose", "Print the plugin debug output."));
+    parser.process(application);
+
+    QTextStream stream(stdout);
+    if (!parser.isSet("verbose"))
+        QLoggingCategory::setFilterRules("ModbusCommander.debug=false\nModbusCommander.warning=false\nqt.modbus*=false");
+
+    if (parser.isSet("request-ids")) {
+        benchmarkRequestIds(parser.value("request-ids").toInt(), stream);
+        return 0;
+    }
+
+    if (parser.isSet("rtu"))
+        return runRtuBenchmark(application, parser, stream);
+
+    return runTcpBenchmark(application, parser, stream);
+}
@@ -0,0 +1,176 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "modbusrtusimulator.h"
+
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QDebug>
+#include <QtMath>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+ModbusRtuSimulator::ModbusRtuSimulator(QObject *parent) :
+    QObject(parent)
+{
+}
+
+ModbusRtuSimulator::~ModbusRtuSimulator()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+void ModbusRtuSimulator::setBaudRate(uint baudRate)
+{
+    m_baudRate = qMax(1u, baudRate);
+}
+
+void ModbusRtuSimulator::setTurnaround(uint turnaround)
+{
+    m_turnaround = turnaround;
+}
+
+void ModbusRtuSimulator::setSlaves(uint firstSlave, uint slaveCount, uint deadSlaveCount)
+{
+    m_firstSlave = firstSlave;
+    m_slaveCount = slaveCount;
+    m_deadSlaveCount = qMin(deadSlaveCount, slaveCount);
+}
+
+void ModbusRtuSimulator::setRegisterCount(uint registerCount)
+{
+    m_slave.setRegisterCount(registerCount);
+}
+
+QString ModbusRtuSimulator::open()
+{
+    m_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (m_fd < 0 || grantpt(m_fd) != 0 || unlockpt(m_fd) != 0)
+        return QString();
+
+    // No echo and no line discipline, the pair has to pass binary frames unchanged
+    struct termios attributes;
+    tcgetattr(m_fd, &attributes);
+    cfmakeraw(&attributes);
+    tcsetattr(m_fd, TCSANOW, &attributes);
+
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &ModbusRtuSimulator::onReadyRead);
+    return QString::fromLocal8Bit(ptsname(m_fd));
+}
+
+quint64 ModbusRtuSimulator::handledRequests() const
+{
+    return m_handledRequests;
+}
+
+int ModbusRtuSimulator::frameLength() const
+{
+    // Request frames of FC 1-6 have a fixed size, FC 15/16 carry their byte count
+    if (m_buffer.size() < 2)
+        return 0;
+
+    quint8 functionCode = static_cast<quint8>(m_buffer.at(1));
+    if (functionCode >= 0x01 && functionCode <= 0x06)
+        return 8;
+
+    if (functionCode == 0x0f || functionCode == 0x10) {
+        if (m_buffer.size() < 7)
+            return 0;
+        return 9 + static_cast<quint8>(m_buffer.at(6));
+    }
+
+    return -1;
+}
+
+double ModbusRtuSimulator::wireTime(int bytes) const
+{
+    // 8N1, ten bits per character
+    return bytes * 10 * 1000.0 / m_baudRate;
+}
+
+quint16 ModbusRtuSimulator::crc16(const QByteArray &data)
+{
+    quint16 crc = 0xffff;
+    foreach (char byte, data) {
+        crc ^= static_cast<quint8>(byte);
+        for (int i = 0; i < 8; i++) {
+            if (crc & 0x0001) {
+                crc = (crc >> 1) ^ 0xa001;
+            } else {
+                crc >>= 1;
+            }
+        }
+    }
+    return crc;
+}
+
+void ModbusRtuSimulator::onReadyRead()
+{
+    char data[512];
+    ssize_t size = 0;
+    while ((size = ::read(m_fd, data, sizeof(data))) > 0) {
+        m_buffer.append(data, static_cast<int>(size));
+    }
+
+    forever {
+        int length = frameLength();
+        if (length < 0) {
+            // Garbage on the line, resynchronize with the next request
+            m_buffer.clear();
+            return;
+        }
+        if (length == 0 || m_buffer.size() < length)
+            return;
+
+        QByteArray frame = m_buffer.left(length);
+        m_buffer.remove(0, length);
+        m_handledRequests++;
+
+        quint16 crc = static_cast<quint8>(frame.at(length - 2)) | (static_cast<quint8>(frame.at(length - 1)) << 8);
+        if (crc16(frame.left(length - 2)) != crc)
+            continue;
+
+        // Broadcasts, unknown and dead slaves stay silent
+        uint slaveAddress = static_cast<quint8>(frame.at(0));
+        if (slaveAddress < m_firstSlave || slaveAddress >= m_firstSlave + m_slaveCount - m_deadSlaveCount)
+            continue;
+
+        QByteArray response;
+        response.append(frame.at(0));
+        response.append(m_slave.processRequest(frame.mid(1, length - 3)));
+        quint16 responseCrc = crc16(response);
+        response.append(static_cast<char>(responseCrc & 0xff));
+        response.append(static_cast<char>(responseCrc >> 8));
+
+        int delay = qCeil(wireTime(length) + m_turnaround + wireTime(response.size()));
+        int fd = m_fd;
+        QTimer::singleShot(delay, Qt::PreciseTimer, this, [fd, response] {
+            if (::write(fd, response.constData(), static_cast<size_t>(response.size())) < 0)
+                qWarning() << "Could not write simulated response";
+        });
+    }
+}
@@ -0,0 +1,73 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MODBUSRTUSIMULATOR_H
+#define MODBUSRTUSIMULATOR_H
+
+#include <QObject>
+#include <QByteArray>
+
+#include "simulatedslave.h"
+
+class QSocketNotifier;
+
+// Simulated RTU bus on the master side of a pseudo-terminal pair, the master under test opens
+// the slave side like a serial port. Responses are delayed by the wire time of both frames at
+// the configured baud rate plus the turnaround of the slave, dead slaves never answer.
+class ModbusRtuSimulator : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ModbusRtuSimulator(QObject *parent = nullptr);
+    ~ModbusRtuSimulator();
+
+    void setBaudRate(uint baudRate);
+    void setTurnaround(uint turnaround);
+    void setSlaves(uint firstSlave, uint slaveCount, uint deadSlaveCount);
+    void setRegisterCount(uint registerCount);
+
+    Q_INVOKABLE QString open();
+    Q_INVOKABLE quint64 handledRequests() const;
+
+private:
+    int m_fd = -1;
+    QSocketNotifier *m_notifier = nullptr;
+    QByteArray m_buffer;
+
+    uint m_baudRate = 9600;
+    uint m_turnaround = 5;
+    uint m_firstSlave = 1;
+    uint m_slaveCount = 1;
+    uint m_deadSlaveCount = 0;
+    quint64 m_handledRequests = 0;
+
+    SimulatedSlave m_slave;
+
+    int frameLength() const;
+    double wireTime(int bytes) const;
+    static quint16 crc16(const QByteArray &data);
+
+private slots:
+    void onReadyRead();
+};
+
+#endif // MODBUSRTUSIMULATOR_H
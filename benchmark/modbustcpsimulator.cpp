@@ -0,0 +1,131 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "modbustcpsimulator.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QtEndian>
+
+ModbusTcpSimulator::ModbusTcpSimulator(QObject *parent) :
+    QObject(parent),
+    m_random(42),
+    m_distribution(0, 1)
+{
+}
+
+void ModbusTcpSimulator::setLatency(uint latency)
+{
+    m_latency = latency;
+}
+
+void ModbusTcpSimulator::setRegisterCount(uint registerCount)
+{
+    m_slave.setRegisterCount(registerCount);
+}
+
+void ModbusTcpSimulator::setExceptionRate(double exceptionRate)
+{
+    m_exceptionRate = exceptionRate;
+}
+
+void ModbusTcpSimulator::setDropRate(double dropRate)
+{
+    m_dropRate = dropRate;
+}
+
+bool ModbusTcpSimulator::listen(quint16 port)
+{
+    // Created here so the server lives in the thread the simulator was moved to
+    if (!m_server) {
+        m_server = new QTcpServer(this);
+        connect(m_server, &QTcpServer::newConnection, this, &ModbusTcpSimulator::onNewConnection);
+    }
+    return m_server->listen(QHostAddress::LocalHost, port);
+}
+
+quint16 ModbusTcpSimulator::serverPort() const
+{
+    return m_server ? m_server->serverPort() : 0;
+}
+
+quint64 ModbusTcpSimulator::handledRequests() const
+{
+    return m_handledRequests;
+}
+
+void ModbusTcpSimulator::onNewConnection()
+{
+    while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+        socket->setParent(this);
+        m_buffers.insert(socket, QByteArray());
+        connect(socket, &QTcpSocket::readyRead, this, &ModbusTcpSimulator::onReadyRead);
+        connect(socket, &QTcpSocket::disconnected, this, [socket, this] {
+            m_buffers.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void ModbusTcpSimulator::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket)
+        return;
+
+    QByteArray &buffer = m_buffers[socket];
+    buffer.append(socket->readAll());
+
+    // MBAP header: transaction id, protocol id, length, unit id
+    while (buffer.size() >= 7) {
+        const uchar *header = reinterpret_cast<const uchar *>(buffer.constData());
+        int length = qFromBigEndian<quint16>(header + 4);
+        if (buffer.size() < 6 + length)
+            break;
+
+        QByteArray request = buffer.left(6 + length);
+        buffer.remove(0, 6 + length);
+        m_handledRequests++;
+
+        if (m_distribution(m_random) < m_dropRate)
+            continue;
+
+        QByteArray pdu = request.mid(7);
+        if (m_distribution(m_random) < m_exceptionRate) {
+            pdu = SimulatedSlave::exceptionResponse(static_cast<quint8>(pdu.value(0)), 0x04);
+        } else {
+            pdu = m_slave.processRequest(pdu);
+        }
+        QByteArray response = request.left(7);
+        qToBigEndian<quint16>(static_cast<quint16>(pdu.size() + 1), reinterpret_cast<uchar *>(response.data()) + 4);
+        response.append(pdu);
+
+        if (m_latency == 0) {
+            socket->write(response);
+        } else {
+            QTimer::singleShot(static_cast<int>(m_latency), socket, [socket, response] {
+                socket->write(response);
+            });
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MODBUSTCPSIMULATOR_H
+#define MODBUSTCPSIMULATOR_H
+
+#include <QObject>
+#include <QHash>
+#include <QByteArray>
+
+#include <random>
+
+#include "simulatedslave.h"
+
+class QTcpServer;
+class QTcpSocket;
+
+// Minimal Modbus TCP slave for benchmarking. Unlike QModbusTcpServer it can delay its
+// responses, answer with exceptions and drop requests to simulate slow or faulty devices.
+class ModbusTcpSimulator : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ModbusTcpSimulator(QObject *parent = nullptr);
+
+    void setLatency(uint latency);
+    void setRegisterCount(uint registerCount);
+    void setExceptionRate(double exceptionRate);
+    void setDropRate(double dropRate);
+
+    Q_INVOKABLE bool listen(quint16 port = 0);
+    Q_INVOKABLE quint16 serverPort() const;
+    Q_INVOKABLE quint64 handledRequests() const;
+
+private:
+    QTcpServer *m_server = nullptr;
+    QHash<QTcpSocket *, QByteArray> m_buffers;
+
+    uint m_latency = 0;
+    double m_exceptionRate = 0;
+    double m_dropRate = 0;
+    quint64 m_handledRequests = 0;
+
+    SimulatedSlave m_slave;
+
+    std::mt19937 m_random;
+    std::uniform_real_distribution<double> m_distribution;
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+};
+
+#endif // MODBUSTCPSIMULATOR_H
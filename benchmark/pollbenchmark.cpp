@@ -0,0 +1,209 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "pollbenchmark.h"
+#include "modbustcpmaster.h"
+#include "modbusrtumaster.h"
+
+#include <time.h>
+#include <algorithm>
+
+PollBenchmark::PollBenchmark(QObject *master, QObject *parent) :
+    QObject(parent),
+    m_master(master)
+{
+    m_scheduler = new PollScheduler(this);
+    connect(m_scheduler, &PollScheduler::pollDue, this, &PollBenchmark::onPollDue);
+
+    if (ModbusTCPMaster *modbusTCPMaster = qobject_cast<ModbusTCPMaster *>(m_master)) {
+        connect(modbusTCPMaster, &ModbusTCPMaster::requestExecuted, this, &PollBenchmark::onRequestExecuted);
+        connect(modbusTCPMaster, &ModbusTCPMaster::requestError, this, &PollBenchmark::onRequestError);
+    } else if (ModbusRTUMaster *modbusRTUMaster = qobject_cast<ModbusRTUMaster *>(m_master)) {
+        connect(modbusRTUMaster, &ModbusRTUMaster::requestExecuted, this, &PollBenchmark::onRequestExecuted);
+        connect(modbusRTUMaster, &ModbusRTUMaster::requestError, this, &PollBenchmark::onRequestError);
+    }
+
+    m_clock.start();
+}
+
+void PollBenchmark::setPoints(uint pointCount, uint slaveCount, QModbusDataUnit::RegisterType registerType)
+{
+    // The planner only uses the device pointers as keys, no real devices are needed
+    m_pointCount = pointCount;
+    m_registerType = registerType;
+    uint pointsPerSlave = (pointCount + qMax(1u, slaveCount) - 1) / qMax(1u, slaveCount);
+    for (uint i = 0; i < pointCount; i++) {
+        Device *device = reinterpret_cast<Device *>(static_cast<quintptr>(i + 1));
+        m_planner.addPoint(device, m_master, 1 + i / pointsPerSlave, registerType, i % pointsPerSlave);
+    }
+}
+
+void PollBenchmark::setBlockLimits(uint maxGap, uint maxSpan)
+{
+    m_planner.setBlockLimits(m_master, maxGap, maxSpan);
+}
+
+void PollBenchmark::setPollInterval(uint pollInterval)
+{
+    m_scheduler->setDefaultInterval(pollInterval);
+    m_planner.setDefaultInterval(m_scheduler->defaultInterval());
+}
+
+void PollBenchmark::start(uint duration)
+{
+    m_duration = duration;
+    m_latencies.reserve(100000);
+    m_startTime = m_clock.nsecsElapsed();
+    m_cpuTime = threadCpuTime();
+
+    m_scheduler->setBlocks(m_planner.blocks());
+    QTimer::singleShot(static_cast<int>(duration), this, &PollBenchmark::onDurationElapsed);
+}
+
+void PollBenchmark::printResults(QTextStream &stream) const
+{
+    double seconds = (m_endTime - m_startTime) / 1e9;
+    uint completed = m_succeeded + m_failed;
+
+    stream << "points:             " << m_pointCount << " in " << m_planner.blocks().count() << " blocks" << endl;
+    stream << "duration:           " << QString::number(seconds, 'f', 2) << " s" << endl;
+    stream << "polls sent:         " << m_sent << endl;
+    stream << "polls succeeded:    " << m_succeeded << endl;
+    stream << "polls failed:       " << m_failed << endl;
+    stream << "polls rejected:     " << m_rejected << endl;
+    stream << "polls skipped:      " << m_monitor.overruns(m_master) << endl;
+    stream << "polls/s:            " << QString::number(seconds > 0 ? m_succeeded / seconds : 0, 'f', 1) << endl;
+    stream << "transactions/s:     " << QString::number(seconds > 0 ? (m_succeeded + m_failed) / seconds : 0, 'f', 1) << endl;
+    stream << "points/s:           " << QString::number(seconds > 0 ? m_succeeded * (static_cast<double>(m_pointCount) / qMax(1, m_planner.blocks().count())) / seconds : 0, 'f', 1) << endl;
+    stream << "latency p50:        " << QString::number(latencyPercentile(50) / 1e6, 'f', 3) << " ms" << endl;
+    stream << "latency p99:        " << QString::number(latencyPercentile(99) / 1e6, 'f', 3) << " ms" << endl;
+    stream << "cpu per request:    " << QString::number(completed > 0 ? m_cpuTime / 1e3 / completed : 0, 'f', 2) << " us" << endl;
+}
+
+ModbusRequestId PollBenchmark::sendReadRequest(const PollBlock &block)
+{
+    ModbusTransaction::Priority priority = ModbusTransaction::PriorityBackground;
+    if (ModbusTCPMaster *modbusTCPMaster = qobject_cast<ModbusTCPMaster *>(m_master)) {
+        switch (block.registerType) {
+        case QModbusDataUnit::RegisterType::Coils:
+            return modbusTCPMaster->readCoil(block.slaveAddress, block.startAddress, block.count, priority);
+        case QModbusDataUnit::RegisterType::DiscreteInputs:
+            return modbusTCPMaster->readDiscreteInput(block.slaveAddress, block.startAddress, block.count, priority);
+        case QModbusDataUnit::RegisterType::HoldingRegisters:
+            return modbusTCPMaster->readHoldingRegister(block.slaveAddress, block.startAddress, block.count, priority);
+        case QModbusDataUnit::RegisterType::InputRegisters:
+            return modbusTCPMaster->readInputRegister(block.slaveAddress, block.startAddress, block.count, priority);
+        default:
+            break;
+        }
+    } else if (ModbusRTUMaster *modbusRTUMaster = qobject_cast<ModbusRTUMaster *>(m_master)) {
+        switch (block.registerType) {
+        case QModbusDataUnit::RegisterType::Coils:
+            return modbusRTUMaster->readCoil(block.slaveAddress, block.startAddress, block.count, priority);
+        case QModbusDataUnit::RegisterType::DiscreteInputs:
+            return modbusRTUMaster->readDiscreteInput(block.slaveAddress, block.startAddress, block.count, priority);
+        case QModbusDataUnit::RegisterType::HoldingRegisters:
+            return modbusRTUMaster->readHoldingRegister(block.slaveAddress, block.startAddress, block.count, priority);
+        case QModbusDataUnit::RegisterType::InputRegisters:
+            return modbusRTUMaster->readInputRegister(block.slaveAddress, block.startAddress, block.count, priority);
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+void PollBenchmark::onPollDue(const PollBlock &block)
+{
+    if (!m_monitor.beginPoll(block))
+        return;
+
+    qint64 sendTime = m_clock.nsecsElapsed();
+    ModbusRequestId requestId = sendReadRequest(block);
+    if (requestId == 0) {
+        m_monitor.cancelPoll(PollCycleMonitor::blockKey(block));
+        m_rejected++;
+        return;
+    }
+
+    PendingPoll poll;
+    poll.block = PollCycleMonitor::blockKey(block);
+    poll.sendTime = sendTime;
+    m_pendingPolls.insert(requestId, poll);
+    m_sent++;
+}
+
+void PollBenchmark::finishPoll(ModbusRequestId requestId, bool success)
+{
+    if (!m_pendingPolls.contains(requestId))
+        return;
+
+    PendingPoll poll = m_pendingPolls.take(requestId);
+    m_monitor.finishPoll(poll.block);
+    if (m_endTime != 0)
+        return;
+
+    if (success) {
+        m_succeeded++;
+        m_latencies.append(m_clock.nsecsElapsed() - poll.sendTime);
+    } else {
+        m_failed++;
+    }
+}
+
+void PollBenchmark::onRequestExecuted(ModbusRequestId requestId, bool success)
+{
+    finishPoll(requestId, success);
+}
+
+void PollBenchmark::onRequestError(ModbusRequestId requestId, const QString &error)
+{
+    Q_UNUSED(error)
+    finishPoll(requestId, false);
+}
+
+void PollBenchmark::onDurationElapsed()
+{
+    m_scheduler->clear();
+    m_endTime = m_clock.nsecsElapsed();
+    m_cpuTime = threadCpuTime() - m_cpuTime;
+    emit finished();
+}
+
+qint64 PollBenchmark::latencyPercentile(int percentile) const
+{
+    if (m_latencies.isEmpty())
+        return 0;
+
+    QVector<qint64> latencies = m_latencies;
+    int index = qMin(latencies.count() - 1, latencies.count() * percentile / 100);
+    std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+    return latencies.at(index);
+}
+
+qint64 PollBenchmark::threadCpuTime()
+{
+    // Only the thread running the master is accounted, the simulator runs in its own thread
+    struct timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<qint64>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
@@ -0,0 +1,95 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef POLLBENCHMARK_H
+#define POLLBENCHMARK_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+#include "pollplanner.h"
+#include "pollscheduler.h"
+#include "pollcyclemonitor.h"
+#include "modbusrequesttable.h"
+
+// Drives a master through the same poll path as the plugin: points are merged into blocks
+// by the PollPlanner, run by the PollScheduler and skipped by the PollCycleMonitor on overrun.
+class PollBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PollBenchmark(QObject *master, QObject *parent = nullptr);
+
+    void setPoints(uint pointCount, uint slaveCount, QModbusDataUnit::RegisterType registerType);
+    void setBlockLimits(uint maxGap, uint maxSpan);
+    void setPollInterval(uint pollInterval);
+
+    void start(uint duration);
+    void printResults(QTextStream &stream) const;
+
+signals:
+    void finished();
+
+private:
+    struct PendingPoll {
+        PollPointKey block;
+        qint64 sendTime = 0;
+    };
+
+    QObject *m_master = nullptr;
+    PollPlanner m_planner;
+    PollScheduler *m_scheduler = nullptr;
+    PollCycleMonitor m_monitor;
+    ModbusRequestTable<PendingPoll> m_pendingPolls;
+
+    uint m_pointCount = 0;
+    QModbusDataUnit::RegisterType m_registerType = QModbusDataUnit::HoldingRegisters;
+    uint m_duration = 0;
+
+    QElapsedTimer m_clock;
+    qint64 m_startTime = 0;
+    qint64 m_endTime = 0;
+    qint64 m_cpuTime = 0;
+
+    uint m_sent = 0;
+    uint m_succeeded = 0;
+    uint m_failed = 0;
+    uint m_rejected = 0;
+    QVector<qint64> m_latencies;
+
+    ModbusRequestId sendReadRequest(const PollBlock &block);
+    void finishPoll(ModbusRequestId requestId, bool success);
+    qint64 latencyPercentile(int percentile) const;
+
+    static qint64 threadCpuTime();
+
+private slots:
+    void onPollDue(const PollBlock &block);
+    void onRequestExecuted(ModbusRequestId requestId, bool success);
+    void onRequestError(ModbusRequestId requestId, const QString &error);
+    void onDurationElapsed();
+};
+
+#endif // POLLBENCHMARK_H
@@ -0,0 +1,128 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "simulatedslave.h"
+
+#include <QtEndian>
+
+SimulatedSlave::SimulatedSlave(uint registerCount)
+{
+    setRegisterCount(registerCount);
+}
+
+void SimulatedSlave::setRegisterCount(uint registerCount)
+{
+    m_registers.resize(static_cast<int>(registerCount));
+    m_bits.resize(static_cast<int>(registerCount));
+    for (int i = 0; i < m_registers.count(); i++) {
+        m_registers[i] = static_cast<quint16>(i);
+        m_bits[i] = (i % 2) != 0;
+    }
+}
+
+QByteArray SimulatedSlave::processRequest(const QByteArray &pdu)
+{
+    if (pdu.size() < 5)
+        return exceptionResponse(static_cast<quint8>(pdu.value(0)), 0x03);
+
+    const uchar *data = reinterpret_cast<const uchar *>(pdu.constData());
+    quint8 functionCode = data[0];
+    int address = qFromBigEndian<quint16>(data + 1);
+    int count = qFromBigEndian<quint16>(data + 3);
+
+    QByteArray response;
+    response.append(static_cast<char>(functionCode));
+
+    switch (functionCode) {
+    case 0x01:
+    case 0x02: {
+        if (count < 1 || count > 2000 || address + count > m_bits.count())
+            return exceptionResponse(functionCode, 0x02);
+
+        QByteArray bits((count + 7) / 8, 0);
+        for (int i = 0; i < count; i++) {
+            if (m_bits.at(address + i))
+                bits[i / 8] = static_cast<char>(bits.at(i / 8) | (1 << (i % 8)));
+        }
+        response.append(static_cast<char>(bits.size()));
+        response.append(bits);
+        break;
+    }
+    case 0x03:
+    case 0x04: {
+        if (count < 1 || count > 125 || address + count > m_registers.count())
+            return exceptionResponse(functionCode, 0x02);
+
+        response.append(static_cast<char>(count * 2));
+        for (int i = 0; i < count; i++) {
+            quint16 value = m_registers.at(address + i);
+            response.append(static_cast<char>(value >> 8));
+            response.append(static_cast<char>(value & 0xff));
+        }
+        break;
+    }
+    case 0x05:
+        // Single writes echo address and value, the second field holds the value
+        if (address >= m_bits.count())
+            return exceptionResponse(functionCode, 0x02);
+
+        m_bits[address] = (count == 0xff00);
+        return pdu.left(5);
+    case 0x06:
+        if (address >= m_registers.count())
+            return exceptionResponse(functionCode, 0x02);
+
+        m_registers[address] = static_cast<quint16>(count);
+        return pdu.left(5);
+    case 0x0f:
+    case 0x10: {
+        int limit = (functionCode == 0x0f) ? m_bits.count() : m_registers.count();
+        int byteCount = (functionCode == 0x0f) ? (count + 7) / 8 : count * 2;
+        if (pdu.size() < 6 + byteCount)
+            return exceptionResponse(functionCode, 0x03);
+        if (count < 1 || address + count > limit)
+            return exceptionResponse(functionCode, 0x02);
+
+        const uchar *values = data + 6;
+        for (int i = 0; i < count; i++) {
+            if (functionCode == 0x0f) {
+                m_bits[address + i] = (values[i / 8] >> (i % 8)) & 0x01;
+            } else {
+                m_registers[address + i] = qFromBigEndian<quint16>(values + 2 * i);
+            }
+        }
+        return pdu.left(5);
+    }
+    default:
+        return exceptionResponse(functionCode, 0x01);
+    }
+
+    return response;
+}
+
+QByteArray SimulatedSlave::exceptionResponse(quint8 functionCode, quint8 exceptionCode)
+{
+    QByteArray response;
+    response.append(static_cast<char>(functionCode | 0x80));
+    response.append(static_cast<char>(exceptionCode));
+    return response;
+}
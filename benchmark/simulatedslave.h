@@ -0,0 +1,45 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef SIMULATEDSLAVE_H
+#define SIMULATEDSLAVE_H
+
+#include <QVector>
+#include <QByteArray>
+
+// Coils, discrete inputs and registers of a simulated slave, answers request PDUs of FC 1-6, 15 and 16
+class SimulatedSlave
+{
+public:
+    explicit SimulatedSlave(uint registerCount = 10000);
+
+    void setRegisterCount(uint registerCount);
+
+    QByteArray processRequest(const QByteArray &pdu);
+    static QByteArray exceptionResponse(quint8 functionCode, quint8 exceptionCode);
+
+private:
+    QVector<quint16> m_registers;
+    QVector<bool> m_bits;
+};
+
+#endif // SIMULATEDSLAVE_H
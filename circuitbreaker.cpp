@@ -0,0 +1,103 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "circuitbreaker.h"
+
+#include <algorithm>
+
+CircuitBreaker::CircuitBreaker(uint failureThreshold, uint probeInterval) :
+    m_failureThreshold(failureThreshold),
+    m_probeInterval(probeInterval)
+{
+    m_clock.start();
+}
+
+void CircuitBreaker::setLimits(uint failureThreshold, uint probeInterval)
+{
+    m_failureThreshold = failureThreshold;
+    m_probeInterval = probeInterval;
+}
+
+bool CircuitBreaker::isAvailable(uint slaveAddress) const
+{
+    return m_slaves.value(slaveAddress).available;
+}
+
+bool CircuitBreaker::startProbe(uint slaveAddress)
+{
+    QHash<uint, SlaveHealth>::iterator health = m_slaves.find(slaveAddress);
+    if (health == m_slaves.end() || health->available)
+        return false;
+
+    // A lost probe doesn't keep the slave out of service, the next one follows one interval later
+    qint64 now = m_clock.elapsed();
+    if (now < health->nextProbe)
+        return false;
+
+    health->nextProbe = now + m_probeInterval;
+    return true;
+}
+
+bool CircuitBreaker::addResponse(uint slaveAddress)
+{
+    QHash<uint, SlaveHealth>::iterator health = m_slaves.find(slaveAddress);
+    if (health == m_slaves.end())
+        return false;
+
+    bool recovered = !health->available;
+    m_slaves.erase(health);
+    return recovered;
+}
+
+bool CircuitBreaker::addFailure(uint slaveAddress)
+{
+    // A threshold of 0 disables the breaker
+    if (m_failureThreshold == 0)
+        return false;
+
+    SlaveHealth &health = m_slaves[slaveAddress];
+    health.failures++;
+    if (!health.available || health.failures < m_failureThreshold)
+        return false;
+
+    health.available = false;
+    health.nextProbe = m_clock.elapsed() + m_probeInterval;
+    return true;
+}
+
+QList<uint> CircuitBreaker::unavailableSlaves() const
+{
+    QList<uint> slaveAddresses;
+    QHash<uint, SlaveHealth>::const_iterator it = m_slaves.constBegin();
+    while (it != m_slaves.constEnd()) {
+        if (!it.value().available)
+            slaveAddresses.append(it.key());
+        ++it;
+    }
+    std::sort(slaveAddresses.begin(), slaveAddresses.end());
+    return slaveAddresses;
+}
+
+void CircuitBreaker::clear()
+{
+    m_slaves.clear();
+}
@@ -0,0 +1,63 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef CIRCUITBREAKER_H
+#define CIRCUITBREAKER_H
+
+#include <QHash>
+#include <QList>
+#include <QElapsedTimer>
+
+// Per slave health on a shared bus. After a number of consecutive missed responses a slave
+// is taken out of service, so it no longer burns a full timeout on every poll. While it is out,
+// a probe is allowed once per probe interval, the first answer puts the slave back into service.
+class CircuitBreaker
+{
+public:
+    explicit CircuitBreaker(uint failureThreshold = 3, uint probeInterval = 10000);
+
+    void setLimits(uint failureThreshold, uint probeInterval);
+
+    bool isAvailable(uint slaveAddress) const;
+    bool startProbe(uint slaveAddress);
+
+    bool addResponse(uint slaveAddress);
+    bool addFailure(uint slaveAddress);
+
+    QList<uint> unavailableSlaves() const;
+    void clear();
+
+private:
+    struct SlaveHealth {
+        uint failures = 0;
+        bool available = true;
+        qint64 nextProbe = 0;
+    };
+
+    uint m_failureThreshold;
+    uint m_probeInterval;
+
+    QElapsedTimer m_clock;
+    QHash<uint, SlaveHealth> m_slaves;
+};
+
+#endif // CIRCUITBREAKER_H
@@ -23,7 +23,10 @@
 
 #include "devicepluginmodbuscommander.h"
 #include "plugininfo.h"
+#include "nymeasettings.h"
 
+#include <QDateTime>
+#include <QDir>
 #include <QSerialPort>
 
 DevicePluginModbusCommander::DevicePluginModbusCommander()
@@ -32,28 +35,104 @@ DevicePluginModbusCommander::DevicePluginModbusCommander()
 
 void DevicePluginModbusCommander::init()
 {
+    m_pollScheduler = new PollScheduler(this);
+    connect(m_pollScheduler, &PollScheduler::pollDue, this, &DevicePluginModbusCommander::readBlock);
+
+    m_startupSequencer = new StartupSequencer(this);
+    m_startupSequencer->setRamp(configValue(modbusCommanderPluginStartupRampParamTypeId).toUInt() * 1000);
+    connect(m_startupSequencer, &StartupSequencer::pointsDue, this, &DevicePluginModbusCommander::onPointsDue);
+
     connect(this, &DevicePluginModbusCommander::configValueChanged, this, &DevicePluginModbusCommander::onPluginConfigurationChanged);
+
+    m_valueCache.open(NymeaSettings::storagePath() + "/modbuscommander-values.cache");
+    // Register maps to import are dropped in here
+    QDir().mkpath(registerMapDirectory());
     //QLoggingCategory::setFilterRules(QStringLiteral("qt.modbus* = false"));
 
     m_slaveAddressParamTypeId.insert(coilDeviceClassId, coilDeviceSlaveAddressParamTypeId);
     m_slaveAddressParamTypeId.insert(inputRegisterDeviceClassId, inputRegisterDeviceSlaveAddressParamTypeId);
     m_slaveAddressParamTypeId.insert(discreteInputDeviceClassId, discreteInputDeviceSlaveAddressParamTypeId);
     m_slaveAddressParamTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterDeviceSlaveAddressParamTypeId);
+    m_slaveAddressParamTypeId.insert(registerBlockDeviceClassId, registerBlockDeviceSlaveAddressParamTypeId);
 
     m_registerAddressParamTypeId.insert(coilDeviceClassId, coilDeviceRegisterAddressParamTypeId);
     m_registerAddressParamTypeId.insert(inputRegisterDeviceClassId, inputRegisterDeviceRegisterAddressParamTypeId);
     m_registerAddressParamTypeId.insert(discreteInputDeviceClassId, discreteInputDeviceRegisterAddressParamTypeId);
     m_registerAddressParamTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterDeviceRegisterAddressParamTypeId);
+    m_registerAddressParamTypeId.insert(registerBlockDeviceClassId, registerBlockDeviceStartAddressParamTypeId);
 
     m_connectedStateTypeId.insert(coilDeviceClassId, coilConnectedStateTypeId);
     m_connectedStateTypeId.insert(inputRegisterDeviceClassId, inputRegisterConnectedStateTypeId);
     m_connectedStateTypeId.insert(discreteInputDeviceClassId, discreteInputConnectedStateTypeId);
     m_connectedStateTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterConnectedStateTypeId);
+    m_connectedStateTypeId.insert(registerBlockDeviceClassId, registerBlockConnectedStateTypeId);
 
     m_valueStateTypeId.insert(coilDeviceClassId, coilValueStateTypeId);
     m_valueStateTypeId.insert(inputRegisterDeviceClassId, inputRegisterValueStateTypeId);
     m_valueStateTypeId.insert(discreteInputDeviceClassId, discreteInputValueStateTypeId);
     m_valueStateTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterValueStateTypeId);
+    m_valueStateTypeId.insert(registerBlockDeviceClassId, registerBlockValuesStateTypeId);
+
+    m_pollIntervalParamTypeId.insert(coilDeviceClassId, coilDevicePollIntervalParamTypeId);
+    m_pollIntervalParamTypeId.insert(inputRegisterDeviceClassId, inputRegisterDevicePollIntervalParamTypeId);
+    m_pollIntervalParamTypeId.insert(discreteInputDeviceClassId, discreteInputDevicePollIntervalParamTypeId);
+    m_pollIntervalParamTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterDevicePollIntervalParamTypeId);
+    m_pollIntervalParamTypeId.insert(registerBlockDeviceClassId, registerBlockDevicePollIntervalParamTypeId);
+
+    m_minPublishIntervalParamTypeId.insert(coilDeviceClassId, coilDeviceMinPublishIntervalParamTypeId);
+    m_minPublishIntervalParamTypeId.insert(inputRegisterDeviceClassId, inputRegisterDeviceMinPublishIntervalParamTypeId);
+    m_minPublishIntervalParamTypeId.insert(discreteInputDeviceClassId, discreteInputDeviceMinPublishIntervalParamTypeId);
+    m_minPublishIntervalParamTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterDeviceMinPublishIntervalParamTypeId);
+
+    m_suppressedUpdatesStateTypeId.insert(coilDeviceClassId, coilSuppressedUpdatesStateTypeId);
+    m_suppressedUpdatesStateTypeId.insert(inputRegisterDeviceClassId, inputRegisterSuppressedUpdatesStateTypeId);
+    m_suppressedUpdatesStateTypeId.insert(discreteInputDeviceClassId, discreteInputSuppressedUpdatesStateTypeId);
+    m_suppressedUpdatesStateTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterSuppressedUpdatesStateTypeId);
+
+    m_staleStateTypeId.insert(coilDeviceClassId, coilStaleStateTypeId);
+    m_staleStateTypeId.insert(inputRegisterDeviceClassId, inputRegisterStaleStateTypeId);
+    m_staleStateTypeId.insert(discreteInputDeviceClassId, discreteInputStaleStateTypeId);
+    m_staleStateTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterStaleStateTypeId);
+
+    m_dataTypeParamTypeId.insert(inputRegisterDeviceClassId, inputRegisterDeviceDataTypeParamTypeId);
+    m_dataTypeParamTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterDeviceDataTypeParamTypeId);
+    m_dataTypeParamTypeId.insert(registerBlockDeviceClassId, registerBlockDeviceDataTypeParamTypeId);
+
+    m_byteOrderParamTypeId.insert(inputRegisterDeviceClassId, inputRegisterDeviceByteOrderParamTypeId);
+    m_byteOrderParamTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterDeviceByteOrderParamTypeId);
+    m_byteOrderParamTypeId.insert(registerBlockDeviceClassId, registerBlockDeviceByteOrderParamTypeId);
+
+    m_scaleParamTypeId.insert(inputRegisterDeviceClassId, inputRegisterDeviceScaleParamTypeId);
+    m_scaleParamTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterDeviceScaleParamTypeId);
+
+    m_registerType.insert(coilDeviceClassId, QModbusDataUnit::RegisterType::Coils);
+    m_registerType.insert(inputRegisterDeviceClassId, QModbusDataUnit::RegisterType::InputRegisters);
+    m_registerType.insert(discreteInputDeviceClassId, QModbusDataUnit::RegisterType::DiscreteInputs);
+    m_registerType.insert(holdingRegisterDeviceClassId, QModbusDataUnit::RegisterType::HoldingRegisters);
+
+    m_scanParamTypeId.insert(coilDeviceClassId, coilDiscoveryScanParamTypeId);
+    m_scanParamTypeId.insert(inputRegisterDeviceClassId, inputRegisterDiscoveryScanParamTypeId);
+    m_scanParamTypeId.insert(discreteInputDeviceClassId, discreteInputDiscoveryScanParamTypeId);
+    m_scanParamTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterDiscoveryScanParamTypeId);
+    m_scanParamTypeId.insert(registerBlockDeviceClassId, registerBlockDiscoveryScanParamTypeId);
+
+    m_firstSlaveAddressParamTypeId.insert(coilDeviceClassId, coilDiscoveryFirstSlaveAddressParamTypeId);
+    m_firstSlaveAddressParamTypeId.insert(inputRegisterDeviceClassId, inputRegisterDiscoveryFirstSlaveAddressParamTypeId);
+    m_firstSlaveAddressParamTypeId.insert(discreteInputDeviceClassId, discreteInputDiscoveryFirstSlaveAddressParamTypeId);
+    m_firstSlaveAddressParamTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterDiscoveryFirstSlaveAddressParamTypeId);
+    m_firstSlaveAddressParamTypeId.insert(registerBlockDeviceClassId, registerBlockDiscoveryFirstSlaveAddressParamTypeId);
+
+    m_lastSlaveAddressParamTypeId.insert(coilDeviceClassId, coilDiscoveryLastSlaveAddressParamTypeId);
+    m_lastSlaveAddressParamTypeId.insert(inputRegisterDeviceClassId, inputRegisterDiscoveryLastSlaveAddressParamTypeId);
+    m_lastSlaveAddressParamTypeId.insert(discreteInputDeviceClassId, discreteInputDiscoveryLastSlaveAddressParamTypeId);
+    m_lastSlaveAddressParamTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterDiscoveryLastSlaveAddressParamTypeId);
+    m_lastSlaveAddressParamTypeId.insert(registerBlockDeviceClassId, registerBlockDiscoveryLastSlaveAddressParamTypeId);
+
+    m_lastRegisterAddressParamTypeId.insert(coilDeviceClassId, coilDiscoveryLastRegisterAddressParamTypeId);
+    m_lastRegisterAddressParamTypeId.insert(inputRegisterDeviceClassId, inputRegisterDiscoveryLastRegisterAddressParamTypeId);
+    m_lastRegisterAddressParamTypeId.insert(discreteInputDeviceClassId, discreteInputDiscoveryLastRegisterAddressParamTypeId);
+    m_lastRegisterAddressParamTypeId.insert(holdingRegisterDeviceClassId, holdingRegisterDiscoveryLastRegisterAddressParamTypeId);
+    m_lastRegisterAddressParamTypeId.insert(registerBlockDeviceClassId, registerBlockDiscoveryLastRegisterAddressParamTypeId);
 }
 
 
@@ -65,23 +144,47 @@ void DevicePluginModbusCommander::setupDevice(DeviceSetupInfo *info)
         QString ipAddress = device->paramValue(modbusTCPClientDeviceIpv4addressParamTypeId).toString();
         uint port = device->paramValue(modbusTCPClientDevicePortParamTypeId).toUInt();
 
+        uint maxRegisterGap = device->paramValue(modbusTCPClientDeviceMaxRegisterGapParamTypeId).toUInt();
+        uint maxBlockSize = device->paramValue(modbusTCPClientDeviceMaxBlockSizeParamTypeId).toUInt();
+        int maxOutstandingPolls = device->paramValue(modbusTCPClientDeviceMaxOutstandingPollsParamTypeId).toInt();
+
         foreach (ModbusTCPMaster *modbusTCPMaster, m_modbusTCPMasters.values()) {
             if ((modbusTCPMaster->ipv4Address() == ipAddress) && (modbusTCPMaster->port() == port)){
+                // The master keeps the settings of the client device that created it
+                Device *sharedDevice = m_masterParents.value(modbusTCPMaster);
+                warnDifferingMasterParams(device, sharedDevice, QList<ParamTypeId>()
+                                          << modbusTCPClientDeviceMaxRegisterGapParamTypeId << modbusTCPClientDeviceMaxBlockSizeParamTypeId
+                                          << modbusTCPClientDeviceMaxOutstandingPollsParamTypeId << modbusTCPClientDeviceMaxInFlightParamTypeId
+                                          << modbusTCPClientDevicePoolSizeParamTypeId << modbusTCPClientDevicePoolStrategyParamTypeId
+                                          << modbusTCPClientDeviceQueueDepthParamTypeId << modbusTCPClientDeviceWriteCoalescingWindowParamTypeId
+                                          << modbusTCPClientDeviceFailureThresholdParamTypeId << modbusTCPClientDeviceProbeIntervalParamTypeId);
+                device->setStateValue(modbusTCPClientConnectedStateTypeId, sharedDevice->stateValue(modbusTCPClientConnectedStateTypeId));
                 m_modbusTCPMasters.insert(device, modbusTCPMaster);
+                m_masterParents.insert(modbusTCPMaster, device);
                 return info->finish(Device::DeviceErrorNoError);
             }
         }
 
-        ModbusTCPMaster *modbusTCPMaster = new ModbusTCPMaster(ipAddress, port, this);
-        connect(modbusTCPMaster, &ModbusTCPMaster::connectionStateChanged, this, &DevicePluginModbusCommander::onConnectionStateChanged);
-        connect(modbusTCPMaster, &ModbusTCPMaster::requestExecuted, this, &DevicePluginModbusCommander::onRequestExecuted);
-        connect(modbusTCPMaster, &ModbusTCPMaster::requestError, this, &DevicePluginModbusCommander::onRequestError);
-        connect(modbusTCPMaster, &ModbusTCPMaster::receivedCoil, this, &DevicePluginModbusCommander::onReceivedCoil);
-        connect(modbusTCPMaster, &ModbusTCPMaster::receivedDiscreteInput, this, &DevicePluginModbusCommander::onReceivedDiscreteInput);
-        connect(modbusTCPMaster, &ModbusTCPMaster::receivedHoldingRegister, this, &DevicePluginModbusCommander::onReceivedHoldingRegister);
-        connect(modbusTCPMaster, &ModbusTCPMaster::receivedInputRegister, this, &DevicePluginModbusCommander::onReceivedInputRegister);
-        modbusTCPMaster->connectDevice();
+        int poolSize = device->paramValue(modbusTCPClientDevicePoolSizeParamTypeId).toInt();
+        // No parent, the master is moved to an I/O thread once it is configured
+        ModbusTCPMaster *modbusTCPMaster = new ModbusTCPMaster(ipAddress, port, poolSize);
+        if (device->paramValue(modbusTCPClientDevicePoolStrategyParamTypeId).toString().contains("Slave")) {
+            modbusTCPMaster->setPoolStrategy(ModbusTCPMaster::PoolStrategySlaveAddress);
+        } else {
+            modbusTCPMaster->setPoolStrategy(ModbusTCPMaster::PoolStrategyLeastLoaded);
+        }
+        modbusTCPMaster->setMaxInFlight(device->paramValue(modbusTCPClientDeviceMaxInFlightParamTypeId).toInt());
+        modbusTCPMaster->setQueueDepth(device->paramValue(modbusTCPClientDeviceQueueDepthParamTypeId).toInt());
+        modbusTCPMaster->setWriteCoalescingWindow(device->paramValue(modbusTCPClientDeviceWriteCoalescingWindowParamTypeId).toUInt());
+        modbusTCPMaster->setCircuitBreaker(device->paramValue(modbusTCPClientDeviceFailureThresholdParamTypeId).toUInt(), device->paramValue(modbusTCPClientDeviceProbeIntervalParamTypeId).toUInt());
+        connectResultChannel(modbusTCPMaster, new ModbusResultChannel(modbusTCPMaster, this));
+        m_ioThreads.moveToTcpThread(modbusTCPMaster);
+        QMetaObject::invokeMethod(modbusTCPMaster, "connectDevice", Qt::QueuedConnection);
         m_modbusTCPMasters.insert(device, modbusTCPMaster);
+        m_masterParents.insert(modbusTCPMaster, device);
+        m_pollPlanner.setBlockLimits(modbusTCPMaster, maxRegisterGap, maxBlockSize);
+        m_pollCycleMonitor.setMaxOutstandingPolls(modbusTCPMaster, maxOutstandingPolls);
+        schedulePollPlan();
         m_asyncTCPSetup.insert(modbusTCPMaster, info);
         return;
 
@@ -100,23 +203,56 @@ void DevicePluginModbusCommander::setupDevice(DeviceSetupInfo *info)
             parity = QSerialPort::Parity::OddParity;
         }
 
-        ModbusRTUMaster *modbusRTUMaster = new ModbusRTUMaster(serialPort, baudrate, parity, dataBits, stopBits, this);
-        connect(modbusRTUMaster, &ModbusRTUMaster::connectionStateChanged, this, &DevicePluginModbusCommander::onConnectionStateChanged);
-        connect(modbusRTUMaster, &ModbusRTUMaster::requestExecuted, this, &DevicePluginModbusCommander::onRequestExecuted);
-        connect(modbusRTUMaster, &ModbusRTUMaster::requestError, this, &DevicePluginModbusCommander::onRequestError);
-        connect(modbusRTUMaster, &ModbusRTUMaster::receivedCoil, this, &DevicePluginModbusCommander::onReceivedCoil);
-        connect(modbusRTUMaster, &ModbusRTUMaster::receivedDiscreteInput, this, &DevicePluginModbusCommander::onReceivedDiscreteInput);
-        connect(modbusRTUMaster, &ModbusRTUMaster::receivedHoldingRegister, this, &DevicePluginModbusCommander::onReceivedHoldingRegister);
-        connect(modbusRTUMaster, &ModbusRTUMaster::receivedInputRegister, this, &DevicePluginModbusCommander::onReceivedInputRegister);
-        modbusRTUMaster->connectDevice();
+        uint maxRegisterGap = device->paramValue(modbusRTUClientDeviceMaxRegisterGapParamTypeId).toUInt();
+        uint maxBlockSize = device->paramValue(modbusRTUClientDeviceMaxBlockSizeParamTypeId).toUInt();
+        int maxOutstandingPolls = device->paramValue(modbusRTUClientDeviceMaxOutstandingPollsParamTypeId).toInt();
+
+        // Client devices on the same port share its master, so all their requests go through one queue
+        foreach (ModbusRTUMaster *modbusRTUMaster, m_modbusRTUMasters.values()) {
+            if (modbusRTUMaster->serialPort() != serialPort)
+                continue;
+
+            if ((modbusRTUMaster->baudrate() != baudrate) || (modbusRTUMaster->parity() != parity)
+                    || (modbusRTUMaster->dataBits() != dataBits) || (modbusRTUMaster->stopBits() != stopBits)) {
+                qCWarning(dcModbusCommander()) << "Serial port" << serialPort << "is already in use with different line settings";
+                return info->finish(Device::DeviceErrorSetupFailed, QT_TR_NOOP("The serial port is already in use with different settings."));
+            }
+
+            // The master keeps the settings of the client device that created it
+            Device *sharedDevice = m_masterParents.value(modbusRTUMaster);
+            warnDifferingMasterParams(device, sharedDevice, QList<ParamTypeId>()
+                                      << modbusRTUClientDeviceMaxRegisterGapParamTypeId << modbusRTUClientDeviceMaxBlockSizeParamTypeId
+                                      << modbusRTUClientDeviceMaxOutstandingPollsParamTypeId << modbusRTUClientDeviceQueueDepthParamTypeId
+                                      << modbusRTUClientDeviceWriteCoalescingWindowParamTypeId << modbusRTUClientDeviceFailureThresholdParamTypeId
+                                      << modbusRTUClientDeviceProbeIntervalParamTypeId);
+            device->setStateValue(modbusRTUClientConnectedStateTypeId, sharedDevice->stateValue(modbusRTUClientConnectedStateTypeId));
+            m_modbusRTUMasters.insert(device, modbusRTUMaster);
+            m_masterParents.insert(modbusRTUMaster, device);
+            return info->finish(Device::DeviceErrorNoError);
+        }
+
+        // No parent, the master is moved to the I/O thread of its port once it is configured
+        ModbusRTUMaster *modbusRTUMaster = new ModbusRTUMaster(serialPort, baudrate, parity, dataBits, stopBits);
+        modbusRTUMaster->setQueueDepth(device->paramValue(modbusRTUClientDeviceQueueDepthParamTypeId).toInt());
+        modbusRTUMaster->setWriteCoalescingWindow(device->paramValue(modbusRTUClientDeviceWriteCoalescingWindowParamTypeId).toUInt());
+        modbusRTUMaster->setCircuitBreaker(device->paramValue(modbusRTUClientDeviceFailureThresholdParamTypeId).toUInt(), device->paramValue(modbusRTUClientDeviceProbeIntervalParamTypeId).toUInt());
+        connectResultChannel(modbusRTUMaster, new ModbusResultChannel(modbusRTUMaster, this));
+        m_ioThreads.moveToSerialThread(modbusRTUMaster, serialPort);
+        QMetaObject::invokeMethod(modbusRTUMaster, "connectDevice", Qt::QueuedConnection);
         m_modbusRTUMasters.insert(device, modbusRTUMaster);
+        m_masterParents.insert(modbusRTUMaster, device);
+        m_pollPlanner.setBlockLimits(modbusRTUMaster, maxRegisterGap, maxBlockSize);
+        m_pollCycleMonitor.setMaxOutstandingPolls(modbusRTUMaster, maxOutstandingPolls);
+        schedulePollPlan();
         m_asyncRTUSetup.insert(modbusRTUMaster, info);
         return;
 
     } else if ((device->deviceClassId() == coilDeviceClassId)
                || (device->deviceClassId() == discreteInputDeviceClassId)
                ||(device->deviceClassId() == holdingRegisterDeviceClassId)
-               || (device->deviceClassId() == inputRegisterDeviceClassId)) {
+               || (device->deviceClassId() == inputRegisterDeviceClassId)
+               || (device->deviceClassId() == registerBlockDeviceClassId)) {
+        restoreValue(device);
         info->finish(Device::DeviceErrorNoError);
         return;
     }
@@ -128,6 +264,11 @@ void DevicePluginModbusCommander::discoverDevices(DeviceDiscoveryInfo *info)
 {
     DeviceClassId deviceClassId = info->deviceClassId();
 
+    if (m_scanParamTypeId.contains(deviceClassId) && info->params().paramValue(m_scanParamTypeId.value(deviceClassId)).toBool()) {
+        scanDevices(info);
+        return;
+    }
+
     if (deviceClassId == modbusRTUClientDeviceClassId) {
         Q_FOREACH(QSerialPortInfo port, QSerialPortInfo::availablePorts()) {
             //Serial port is not yet used, create now a new one
@@ -136,15 +277,19 @@ void DevicePluginModbusCommander::discoverDevices(DeviceDiscoveryInfo *info)
             DeviceDescriptor deviceDescriptor(deviceClassId, port.portName(), description);
             ParamList parameters;
             QString serialPort = port.systemLocation();
+            parameters.append(Param(modbusRTUClientDeviceSerialPortParamTypeId, serialPort));
+            deviceDescriptor.setParams(parameters);
+            info->addDeviceDescriptor(deviceDescriptor);
+
+            // Clients already on this port can be reconfigured, a further client shares the port with them
             foreach (Device *existingDevice, myDevices()) {
                 if (existingDevice->paramValue(modbusRTUClientDeviceSerialPortParamTypeId).toString() == serialPort) {
-                    deviceDescriptor.setDeviceId(existingDevice->id());
-                    break;
+                    DeviceDescriptor existingDescriptor(deviceClassId, existingDevice->name(), description);
+                    existingDescriptor.setDeviceId(existingDevice->id());
+                    existingDescriptor.setParams(parameters);
+                    info->addDeviceDescriptor(existingDescriptor);
                 }
             }
-            parameters.append(Param(modbusRTUClientDeviceSerialPortParamTypeId, serialPort));
-            deviceDescriptor.setParams(parameters);
-            info->addDeviceDescriptor(deviceDescriptor);
         }
         info->finish(Device::DeviceErrorNoError);
         return;
@@ -210,25 +355,281 @@ void DevicePluginModbusCommander::discoverDevices(DeviceDiscoveryInfo *info)
         }
         info->finish(Device::DeviceErrorNoError);
         return;
+
+    } else if (deviceClassId == registerBlockDeviceClassId) {
+        Q_FOREACH(Device *clientDevice, myDevices()){
+            if (clientDevice->deviceClassId() == modbusTCPClientDeviceClassId) {
+                DeviceDescriptor descriptor(deviceClassId, "Register block", clientDevice->name() + " " + clientDevice->paramValue(modbusTCPClientDeviceIpv4addressParamTypeId).toString() + " Port: " + clientDevice->paramValue(modbusTCPClientDevicePortParamTypeId).toString());
+                descriptor.setParentDeviceId(clientDevice->id());
+                info->addDeviceDescriptor(descriptor);
+            }
+            if (clientDevice->deviceClassId() == modbusRTUClientDeviceClassId) {
+                DeviceDescriptor descriptor(deviceClassId, "Register block", clientDevice->name() + " " + clientDevice->paramValue(modbusRTUClientDeviceSerialPortParamTypeId).toString());
+                descriptor.setParentDeviceId(clientDevice->id());
+                info->addDeviceDescriptor(descriptor);
+            }
+        }
+        info->finish(Device::DeviceErrorNoError);
+        return;
     }
     info->finish(Device::DeviceErrorDeviceClassNotFound);
     qCWarning(dcModbusCommander()) << "Unhandled device class in discovery!";
 }
 
+void DevicePluginModbusCommander::scanDevices(DeviceDiscoveryInfo *info)
+{
+    DeviceClassId deviceClassId = info->deviceClassId();
+    QList<QModbusDataUnit::RegisterType> registerTypes;
+    if (deviceClassId == registerBlockDeviceClassId) {
+        registerTypes << QModbusDataUnit::RegisterType::Coils << QModbusDataUnit::RegisterType::DiscreteInputs
+                      << QModbusDataUnit::RegisterType::InputRegisters << QModbusDataUnit::RegisterType::HoldingRegisters;
+    } else {
+        registerTypes << m_registerType.value(deviceClassId);
+    }
+
+    // One scan per bus, client devices sharing a master get its results once
+    QHash<ModbusScanner *, DeviceId> scanners;
+    foreach (QObject *modbus, m_masterParents.uniqueKeys()) {
+        ModbusResultChannel *channel = m_resultChannels.value(modbus);
+        if (!channel)
+            continue;
+
+        ModbusScanner *scanner = new ModbusScanner(modbus, channel, info);
+        scanner->setSlaveAddresses(info->params().paramValue(m_firstSlaveAddressParamTypeId.value(deviceClassId)).toUInt(),
+                                   info->params().paramValue(m_lastSlaveAddressParamTypeId.value(deviceClassId)).toUInt());
+        scanner->setLastRegisterAddress(info->params().paramValue(m_lastRegisterAddressParamTypeId.value(deviceClassId)).toUInt());
+        scanner->setRegisterTypes(registerTypes);
+        if (qobject_cast<ModbusRTUMaster *>(modbus)) {
+            // The bus carries one frame at a time, the next probe waits in the queue of the master so the line never idles.
+            // Absent slaves must not hold it for a full response timeout
+            scanner->setConcurrency(2);
+            scanner->setTimeout(100);
+        } else {
+            // Gateways hold the request of an absent slave for their own timeout, the scan must not wait for the estimated one
+            scanner->setConcurrency(32);
+            scanner->setTimeout(500);
+        }
+        scanners.insert(scanner, m_masterParents.value(modbus)->id());
+    }
+
+    if (scanners.isEmpty()) {
+        info->finish(Device::DeviceErrorNoError);
+        return;
+    }
+
+    foreach (ModbusScanner *scanner, scanners.keys()) {
+        // Slaves show up as soon as their ranges are known, a scan cut short keeps them
+        DeviceId parentDeviceId = scanners.value(scanner);
+        connect(scanner, &ModbusScanner::slaveScanned, info, [this, info, parentDeviceId](uint slaveAddress, const QList<ModbusScanner::Range> &ranges) {
+            Q_UNUSED(slaveAddress)
+            Device *parentDevice = myDevices().findById(parentDeviceId);
+            if (parentDevice)
+                addScannedDevices(info, parentDevice, ranges);
+        });
+        connect(scanner, &ModbusScanner::finished, info, [info, scanners] {
+            foreach (ModbusScanner *other, scanners.keys()) {
+                if (!other->isFinished())
+                    return;
+            }
+            info->finish(Device::DeviceErrorNoError);
+        });
+    }
+
+    // A long scan ends with what it found before the discovery runs out of time
+    QTimer::singleShot(ScanDeadline, info, [scanners] {
+        foreach (ModbusScanner *scanner, scanners.keys()) {
+            if (!scanner->isFinished())
+                qCWarning(dcModbusCommander()) << "Scan did not finish in time, reporting the slaves found so far";
+            scanner->stop();
+        }
+    });
+
+    // All buses are scanned side by side
+    foreach (ModbusScanner *scanner, scanners.keys()) {
+        scanner->start();
+    }
+}
+
+void DevicePluginModbusCommander::addScannedDevices(DeviceDiscoveryInfo *info, Device *parentDevice, const QList<ModbusScanner::Range> &ranges)
+{
+    DeviceClassId deviceClassId = info->deviceClassId();
+    QObject *modbus = modbusMaster(parentDevice);
+    QString displayName = supportedDevices().findById(deviceClassId).displayName();
+
+    foreach (const ModbusScanner::Range &range, ranges) {
+        if (deviceClassId == registerBlockDeviceClassId) {
+            QString registerType = "Holding register";
+            if (range.registerType == QModbusDataUnit::RegisterType::Coils) {
+                registerType = "Coil";
+            } else if (range.registerType == QModbusDataUnit::RegisterType::DiscreteInputs) {
+                registerType = "Discrete input";
+            } else if (range.registerType == QModbusDataUnit::RegisterType::InputRegisters) {
+                registerType = "Input register";
+            }
+
+            // A block has to fit into a single response frame
+            uint span = PollPlanner::maxRequestSpan(range.registerType);
+            for (uint address = range.startAddress; address < range.startAddress + range.count; address += span) {
+                if (m_pointIndex.contains(PollPointKey(modbus, range.slaveAddress, range.registerType, address)))
+                    continue;
+
+                uint count = qMin(span, range.startAddress + range.count - address);
+                DeviceDescriptor descriptor(deviceClassId, displayName, QString("%1 Slave: %2 %3 %4-%5").arg(parentDevice->name()).arg(range.slaveAddress).arg(registerType).arg(address).arg(address + count - 1));
+                descriptor.setParentDeviceId(parentDevice->id());
+                ParamList params;
+                params.append(Param(registerBlockDeviceSlaveAddressParamTypeId, range.slaveAddress));
+                params.append(Param(registerBlockDeviceRegisterTypeParamTypeId, registerType));
+                params.append(Param(registerBlockDeviceStartAddressParamTypeId, address));
+                params.append(Param(registerBlockDeviceCountParamTypeId, count));
+                descriptor.setParams(params);
+                info->addDeviceDescriptor(descriptor);
+            }
+            continue;
+        }
+
+        if (range.registerType != m_registerType.value(deviceClassId))
+            continue;
+
+        // Registers already added as devices are not offered again
+        for (uint address = range.startAddress; address < range.startAddress + range.count; address++) {
+            if (m_pointIndex.contains(PollPointKey(modbus, range.slaveAddress, range.registerType, address)))
+                continue;
+
+            DeviceDescriptor descriptor(deviceClassId, displayName, QString("%1 Slave: %2 Register: %3").arg(parentDevice->name()).arg(range.slaveAddress).arg(address));
+            descriptor.setParentDeviceId(parentDevice->id());
+            ParamList params;
+            params.append(Param(m_slaveAddressParamTypeId.value(deviceClassId), range.slaveAddress));
+            params.append(Param(m_registerAddressParamTypeId.value(deviceClassId), address));
+            descriptor.setParams(params);
+            info->addDeviceDescriptor(descriptor);
+        }
+    }
+}
+
+void DevicePluginModbusCommander::importRegisterMap(DeviceActionInfo *info)
+{
+    Device *parent = info->device();
+    QString fileName = info->action().param(parent->deviceClassId() == modbusTCPClientDeviceClassId ? modbusTCPClientImportRegisterMapActionFileNameParamTypeId : modbusRTUClientImportRegisterMapActionFileNameParamTypeId).value().toString();
+
+    // Only files inside the register map directory of the plugin can be imported
+    QDir directory(registerMapDirectory());
+    QString relativePath = QDir::cleanPath(fileName);
+    if (relativePath.isEmpty() || QDir::isAbsolutePath(relativePath) || relativePath == ".." || relativePath.startsWith("../")) {
+        qCWarning(dcModbusCommander()) << "Refusing to import register map" << fileName << "from outside of" << directory.path();
+        info->finish(Device::DeviceErrorInvalidParameter, QT_TR_NOOP("The register map file must be inside the register map directory."));
+        return;
+    }
+
+    // Points of a previous import are still being set up, they would get mixed up
+    if (m_registerMapImports.contains(parent->id())) {
+        info->finish(Device::DeviceErrorDeviceInUse, QT_TR_NOOP("A register map import is already in progress."));
+        return;
+    }
+
+    RegisterMap registerMap;
+    if (!registerMap.load(directory.filePath(relativePath))) {
+        qCWarning(dcModbusCommander()) << "Could not import register map:" << registerMap.errorString();
+        info->finish(Device::DeviceErrorInvalidParameter, registerMap.errorString());
+        return;
+    }
+
+    QObject *modbus = modbusMaster(parent);
+    if (!modbus) {
+        info->finish(Device::DeviceErrorHardwareNotAvailable);
+        return;
+    }
+
+    // All points appear in one batch, registers already added as devices are skipped
+    RegisterMapImport import;
+    import.generation = ++m_registerMapImportGeneration;
+    DeviceDescriptors descriptors;
+    foreach (const RegisterMap::Entry &entry, registerMap.entries()) {
+        PollPointKey key(modbus, entry.slaveAddress, entry.registerType, entry.registerAddress);
+        if (m_pointIndex.contains(key) || import.pending.contains(key))
+            continue;
+
+        DeviceClassId deviceClassId = m_registerType.key(entry.registerType);
+        DeviceDescriptor descriptor(deviceClassId, entry.name, parent->name());
+        descriptor.setParentDeviceId(parent->id());
+        ParamList params;
+        params.append(Param(m_slaveAddressParamTypeId.value(deviceClassId), entry.slaveAddress));
+        params.append(Param(m_registerAddressParamTypeId.value(deviceClassId), entry.registerAddress));
+        params.append(Param(m_pollIntervalParamTypeId.value(deviceClassId), entry.pollInterval));
+        if (m_dataTypeParamTypeId.contains(deviceClassId))
+            params.append(Param(m_dataTypeParamTypeId.value(deviceClassId), entry.dataType));
+        if (m_scaleParamTypeId.contains(deviceClassId))
+            params.append(Param(m_scaleParamTypeId.value(deviceClassId), entry.scale));
+        descriptor.setParams(params);
+        descriptors.append(descriptor);
+        import.pending.insert(key);
+    }
+
+    qCDebug(dcModbusCommander()) << "Importing" << descriptors.count() << "of" << registerMap.entries().count() << "points from" << fileName;
+    if (!import.pending.isEmpty()) {
+        m_registerMapImports.insert(parent->id(), import);
+        emit autoDevicesAppeared(descriptors);
+        // Points refused by the device manager never show up, the others are not held back forever
+        DeviceId parentDeviceId = parent->id();
+        uint generation = import.generation;
+        QTimer::singleShot(30000, this, [this, parentDeviceId, generation] {
+            // The import may have finished already and a later one taken its place
+            if (m_registerMapImports.value(parentDeviceId).generation == generation)
+                finishRegisterMapImport(parentDeviceId);
+        });
+    }
+    info->finish(Device::DeviceErrorNoError);
+}
+
+QString DevicePluginModbusCommander::registerMapDirectory() const
+{
+    return NymeaSettings::storagePath() + "/modbuscommander-registermaps";
+}
+
+void DevicePluginModbusCommander::finishRegisterMapImport(const DeviceId &parentDeviceId)
+{
+    if (!m_registerMapImports.contains(parentDeviceId))
+        return;
+
+    RegisterMapImport import = m_registerMapImports.take(parentDeviceId);
+    qCDebug(dcModbusCommander()) << "Register map import finished," << import.devices.count() << "points set up";
+
+    QObject *modbus = modbusMaster(myDevices().findById(parentDeviceId));
+    if (!modbus)
+        return;
+
+    foreach (Device *device, import.devices) {
+        m_startupSequencer->addPoint(modbus, device, lastUpdate(device));
+    }
+}
+
 void DevicePluginModbusCommander::postSetupDevice(Device *device)
 {
-    if (!m_refreshTimer) {
-        // Refresh timer for TCP read
-        int refreshTime = configValue(modbusCommanderPluginUpdateIntervalParamTypeId).toInt();
-        m_refreshTimer = hardwareManager()->pluginTimerManager()->registerTimer(refreshTime);
-        connect(m_refreshTimer, &PluginTimer::timeout, this, &DevicePluginModbusCommander::onRefreshTimer);
+    if (!m_statusTimer) {
+        // Low rate refresh of the bus statistics states
+        m_statusTimer = hardwareManager()->pluginTimerManager()->registerTimer(10);
+        connect(m_statusTimer, &PluginTimer::timeout, this, &DevicePluginModbusCommander::onStatusTimer);
     }
 
     if ((device->deviceClassId() == coilDeviceClassId) ||
             (device->deviceClassId() == discreteInputDeviceClassId) ||
             (device->deviceClassId() == holdingRegisterDeviceClassId) ||
-            (device->deviceClassId() == inputRegisterDeviceClassId)) {
-        readRegister(device);
+            (device->deviceClassId() == inputRegisterDeviceClassId) ||
+            (device->deviceClassId() == registerBlockDeviceClassId)) {
+        addPoint(device);
+
+        // Points of a register map import are read together once all of them are set up
+        if (m_registerMapImports.contains(device->parentId()) && m_registerMapImports[device->parentId()].pending.remove(m_pointKeys.value(device))) {
+            RegisterMapImport &import = m_registerMapImports[device->parentId()];
+            import.devices.append(device);
+            if (import.pending.isEmpty())
+                finishRegisterMapImport(device->parentId());
+            return;
+        }
+
+        // The first read waits for the connection of the master and its wave
+        QObject *modbus = modbusMaster(myDevices().findById(device->parentId()));
+        if (modbus)
+            m_startupSequencer->addPoint(modbus, device, lastUpdate(device));
     }
 }
 
@@ -237,7 +638,19 @@ void DevicePluginModbusCommander::executeAction(DeviceActionInfo *info)
 {
     Device *device = info->device();
 
-    if (device->deviceClassId() == coilDeviceClassId) {
+    if (device->deviceClassId() == modbusTCPClientDeviceClassId) {
+
+        if (info->action().actionTypeId() == modbusTCPClientImportRegisterMapActionTypeId) {
+            importRegisterMap(info);
+            return;
+        }
+    } else if (device->deviceClassId() == modbusRTUClientDeviceClassId) {
+
+        if (info->action().actionTypeId() == modbusRTUClientImportRegisterMapActionTypeId) {
+            importRegisterMap(info);
+            return;
+        }
+    } else if (device->deviceClassId() == coilDeviceClassId) {
 
         if (info->action().actionTypeId() == coilValueActionTypeId) {
             writeRegister(device, info);
@@ -259,28 +672,228 @@ void DevicePluginModbusCommander::deviceRemoved(Device *device)
 {
     if (device->deviceClassId() == modbusTCPClientDeviceClassId) {
         ModbusTCPMaster *modbus = m_modbusTCPMasters.take(device);
-        modbus->deleteLater();
+        m_masterParents.remove(modbus, device);
+        // The master stays as long as other client devices share it
+        if (!m_masterParents.contains(modbus)) {
+            m_pollPlanner.removeMaster(modbus);
+            m_pollCycleMonitor.removeMaster(modbus);
+            schedulePollPlan();
+            // Replies of a deleted master never arrive
+            foreach (ModbusRequestId requestId, m_readRequests.keys()) {
+                if (m_readRequests.find(requestId)->master == modbus)
+                    m_readRequests.remove(requestId);
+            }
+            m_resultChannels.remove(modbus);
+            m_startupSequencer->removeMaster(modbus);
+            m_ioThreads.removeMaster(modbus);
+        }
     }
 
     if (device->deviceClassId() == modbusRTUClientDeviceClassId) {
         ModbusRTUMaster *modbus = m_modbusRTUMasters.take(device);
-        modbus->deleteLater();
+        m_masterParents.remove(modbus, device);
+        // The master stays as long as other client devices share it
+        if (!m_masterParents.contains(modbus)) {
+            m_pollPlanner.removeMaster(modbus);
+            m_pollCycleMonitor.removeMaster(modbus);
+            schedulePollPlan();
+            // Replies of a deleted master never arrive
+            foreach (ModbusRequestId requestId, m_readRequests.keys()) {
+                if (m_readRequests.find(requestId)->master == modbus)
+                    m_readRequests.remove(requestId);
+            }
+            m_resultChannels.remove(modbus);
+            m_startupSequencer->removeMaster(modbus);
+            m_ioThreads.removeMaster(modbus);
+        }
+    }
+
+    m_registerMapImports.remove(device->id());
+
+    if (m_registerAddressParamTypeId.contains(device->deviceClassId())) {
+        if (m_registerMapImports.contains(device->parentId()))
+            m_registerMapImports[device->parentId()].devices.removeAll(device);
+        m_startupSequencer->removePoint(device);
+        m_valueCache.remove(device->id());
+        removePoint(device);
+        m_publishFilter.removeDevice(device);
+        foreach (ModbusRequestId requestId, m_readRequests.keys()) {
+            m_readRequests.find(requestId)->devices.removeAll(device);
+        }
     }
 
     if (myDevices().empty()) {
-        hardwareManager()->pluginTimerManager()->unregisterTimer(m_refreshTimer);
-        m_refreshTimer = nullptr;
+        hardwareManager()->pluginTimerManager()->unregisterTimer(m_statusTimer);
+        m_statusTimer = nullptr;
+    }
+}
+
+void DevicePluginModbusCommander::schedulePollPlan()
+{
+    // Several devices are usually set up or removed in a row, rebuild the plan only once for all of them
+    if (m_pollPlanPending)
+        return;
+
+    m_pollPlanPending = true;
+    QTimer::singleShot(0, this, &DevicePluginModbusCommander::onPollPlanChanged);
+}
+
+void DevicePluginModbusCommander::onPollPlanChanged()
+{
+    m_pollPlanPending = false;
+    m_pollScheduler->setDefaultInterval(configValue(modbusCommanderPluginUpdateIntervalParamTypeId).toUInt() * 1000);
+    m_pollPlanner.setDefaultInterval(m_pollScheduler->defaultInterval());
+    m_pollScheduler->setBlocks(m_pollPlanner.blocks());
+    m_pollCycleMonitor.clearCycleTimes();
+}
+
+void DevicePluginModbusCommander::connectResultChannel(QObject *modbus, ModbusResultChannel *channel)
+{
+    m_resultChannels.insert(modbus, channel);
+    // Results of the I/O threads arrive here in batches, only state changes are left to do
+    connect(channel, &ModbusResultChannel::connectionStateChanged, this, &DevicePluginModbusCommander::onConnectionStateChanged);
+    connect(channel, &ModbusResultChannel::requestExecuted, this, &DevicePluginModbusCommander::onRequestExecuted);
+    connect(channel, &ModbusResultChannel::requestError, this, &DevicePluginModbusCommander::onRequestError);
+    connect(channel, &ModbusResultChannel::receivedValues, this, &DevicePluginModbusCommander::onReceivedValues);
+    connect(channel, &ModbusResultChannel::statusReported, this, &DevicePluginModbusCommander::onStatusReported);
+}
+
+void DevicePluginModbusCommander::warnDifferingMasterParams(Device *device, Device *sharedDevice, const QList<ParamTypeId> &paramTypeIds) const
+{
+    QStringList differingParams;
+    foreach (const ParamTypeId &paramTypeId, paramTypeIds) {
+        if (device->paramValue(paramTypeId) != sharedDevice->paramValue(paramTypeId))
+            differingParams.append(supportedDevices().findById(device->deviceClassId()).paramTypes().findById(paramTypeId).name());
+    }
+
+    if (!differingParams.isEmpty())
+        qCWarning(dcModbusCommander()) << device->name() << "shares the master of" << sharedDevice->name() << "and uses its settings, ignoring" << differingParams.join(", ");
+}
+
+void DevicePluginModbusCommander::logStatistics(const QString &name, const ModbusStatistics &statistics, uint busUtilization) const
+{
+    qCDebug(dcModbusCommander()) << name << statistics.requests() << "responses," << statistics.requestRate() << "requests/s, round trip time average" << statistics.averageRoundTripTime()
+                                 << "ms, p50" << statistics.roundTripTimePercentile(50) << "ms, p95" << statistics.roundTripTimePercentile(95) << "ms, p99" << statistics.roundTripTimePercentile(99)
+                                 << "ms, bus utilization" << busUtilization << "%," << statistics.timeouts() << "timeouts," << statistics.exceptionResponses() << "exceptions," << statistics.frameErrors() << "frame errors";
+}
+
+void DevicePluginModbusCommander::setStatisticsStates(Device *device, const ModbusStatistics &statistics, uint busUtilization)
+{
+    // Exception codes as "code: count" pairs, e.g. "2: 14, 4: 1"
+    QStringList exceptionCodes;
+    QMap<int, uint> codes = statistics.exceptionCodes();
+    foreach (int code, codes.keys()) {
+        exceptionCodes.append(QString("%1: %2").arg(code).arg(codes.value(code)));
+    }
+
+    if (device->deviceClassId() == modbusRTUClientDeviceClassId) {
+        device->setStateValue(modbusRTUClientRoundTripTimeStateTypeId, statistics.roundTripTimePercentile(50));
+        device->setStateValue(modbusRTUClientRoundTripTimeP95StateTypeId, statistics.roundTripTimePercentile(95));
+        device->setStateValue(modbusRTUClientRequestRateStateTypeId, statistics.requestRate());
+        device->setStateValue(modbusRTUClientBusUtilizationStateTypeId, busUtilization);
+        device->setStateValue(modbusRTUClientTimeoutsStateTypeId, statistics.timeouts());
+        device->setStateValue(modbusRTUClientExceptionResponsesStateTypeId, statistics.exceptionResponses());
+        device->setStateValue(modbusRTUClientExceptionCodesStateTypeId, exceptionCodes.join(", "));
+        device->setStateValue(modbusRTUClientFrameErrorsStateTypeId, statistics.frameErrors());
+    } else if (device->deviceClassId() == modbusTCPClientDeviceClassId) {
+        device->setStateValue(modbusTCPClientRoundTripTimeStateTypeId, statistics.roundTripTimePercentile(50));
+        device->setStateValue(modbusTCPClientRoundTripTimeP95StateTypeId, statistics.roundTripTimePercentile(95));
+        device->setStateValue(modbusTCPClientRequestRateStateTypeId, statistics.requestRate());
+        device->setStateValue(modbusTCPClientBusUtilizationStateTypeId, busUtilization);
+        device->setStateValue(modbusTCPClientTimeoutsStateTypeId, statistics.timeouts());
+        device->setStateValue(modbusTCPClientExceptionResponsesStateTypeId, statistics.exceptionResponses());
+        device->setStateValue(modbusTCPClientExceptionCodesStateTypeId, exceptionCodes.join(", "));
+        device->setStateValue(modbusTCPClientFrameErrorsStateTypeId, statistics.frameErrors());
+    }
+}
+
+void DevicePluginModbusCommander::setReconnectStates(Device *device, const ModbusMasterStatus &status)
+{
+    if (device->deviceClassId() == modbusRTUClientDeviceClassId) {
+        device->setStateValue(modbusRTUClientReconnectAttemptsStateTypeId, status.reconnectAttempts);
+        device->setStateValue(modbusRTUClientReconnectBackoffStateTypeId, status.reconnectBackoff);
+        device->setStateValue(modbusRTUClientReconnectTimeStateTypeId, status.reconnectTime);
+    } else if (device->deviceClassId() == modbusTCPClientDeviceClassId) {
+        device->setStateValue(modbusTCPClientReconnectAttemptsStateTypeId, status.reconnectAttempts);
+        device->setStateValue(modbusTCPClientReconnectBackoffStateTypeId, status.reconnectBackoff);
+        device->setStateValue(modbusTCPClientReconnectTimeStateTypeId, status.reconnectTime);
+    }
+}
+
+void DevicePluginModbusCommander::setUnavailableSlavesState(Device *device, const ModbusMasterStatus &status)
+{
+    QStringList slaveAddresses;
+    foreach (uint slaveAddress, status.unavailableSlaves) {
+        slaveAddresses.append(QString::number(slaveAddress));
+    }
+
+    if (device->deviceClassId() == modbusRTUClientDeviceClassId) {
+        device->setStateValue(modbusRTUClientUnavailableSlavesStateTypeId, slaveAddresses.join(", "));
+    } else if (device->deviceClassId() == modbusTCPClientDeviceClassId) {
+        device->setStateValue(modbusTCPClientUnavailableSlavesStateTypeId, slaveAddresses.join(", "));
+    }
+}
+
+void DevicePluginModbusCommander::onStatusTimer()
+{
+    foreach (Device *device, m_pointKeys.keys()) {
+        if (!m_suppressedUpdatesStateTypeId.contains(device->deviceClassId()))
+            continue;
+
+        StateTypeId suppressedUpdatesStateTypeId = m_suppressedUpdatesStateTypeId.value(device->deviceClassId());
+        uint suppressedUpdates = m_publishFilter.suppressedUpdates(device);
+        if (device->stateValue(suppressedUpdatesStateTypeId).toUInt() != suppressedUpdates)
+            device->setStateValue(suppressedUpdatesStateTypeId, suppressedUpdates);
+    }
+
+    // The masters take their snapshot in their own thread, the results come back through their result channel
+    foreach (QObject *modbus, m_masterParents.uniqueKeys()) {
+        QMetaObject::invokeMethod(modbus, "reportStatus", Qt::QueuedConnection);
     }
 }
 
-void DevicePluginModbusCommander::onRefreshTimer()
+void DevicePluginModbusCommander::onStatusReported(QObject *modbus, const ModbusMasterStatus &status)
 {
-    foreach (Device *device, myDevices()) {
-        if ((device->deviceClassId() == coilDeviceClassId) ||
-                (device->deviceClassId() == discreteInputDeviceClassId) ||
-                (device->deviceClassId() == holdingRegisterDeviceClassId) ||
-                (device->deviceClassId() == inputRegisterDeviceClassId)) {
-            readRegister(device);
+    // The master may have been removed while its report was on the way
+    if (!m_masterParents.contains(modbus))
+        return;
+
+    if (ModbusRTUMaster *modbusRTUMaster = qobject_cast<ModbusRTUMaster *>(modbus)) {
+        qCDebug(dcModbusCommander()) << modbusRTUMaster->serialPort() << "queue wait time average" << status.averageQueueWaitTime << "ms, max" << status.maxQueueWaitTime << "ms," << status.pendingRequests << "requests pending";
+        logStatistics(modbusRTUMaster->serialPort(), status.statistics, status.busUtilization);
+        qCDebug(dcModbusCommander()) << modbusRTUMaster->serialPort() << status.reconnectAttempts << "reconnect attempts, backoff" << status.reconnectBackoff << "ms, last reconnect took" << status.reconnectTime << "ms";
+        uint cycleTime = m_pollCycleMonitor.averageCycleTime(modbus);
+        qCDebug(dcModbusCommander()) << modbusRTUMaster->serialPort() << "effective cycle time" << cycleTime << "ms," << m_pollCycleMonitor.overruns(modbus) << "polls skipped," << m_pollCycleMonitor.freshSkips(modbus) << "polls of fresh values skipped," << m_pollCycleMonitor.outstandingPolls(modbus) << "polls outstanding";
+        m_pollCycleMonitor.resetCycleTimeStatistics(modbus);
+        foreach (Device *device, m_masterParents.values(modbus)) {
+            setStatisticsStates(device, status.statistics, status.busUtilization);
+            setReconnectStates(device, status);
+            setUnavailableSlavesState(device, status);
+            device->setStateValue(modbusRTUClientQueueWaitTimeStateTypeId, status.averageQueueWaitTime);
+            device->setStateValue(modbusRTUClientPollOverrunsStateTypeId, m_pollCycleMonitor.overruns(modbus));
+            device->setStateValue(modbusRTUClientCycleTimeStateTypeId, cycleTime);
+        }
+    } else if (ModbusTCPMaster *modbusTCPMaster = qobject_cast<ModbusTCPMaster *>(modbus)) {
+        qCDebug(dcModbusCommander()) << modbusTCPMaster->ipv4Address() << "queue wait time average" << status.averageQueueWaitTime << "ms, max" << status.maxQueueWaitTime << "ms," << status.peakInFlight << "of" << status.maxInFlight << "requests in flight at peak," << status.pendingRequests << "requests pending";
+        QStringList utilization;
+        for (int i = 0; i < status.connectionUtilization.count(); i++) {
+            utilization.append(QString("%1 %").arg(status.connectionUtilization.at(i)));
+            qCDebug(dcModbusCommander()) << modbusTCPMaster->ipv4Address() << "connection" << i << "utilization" << status.connectionUtilization.at(i) << "%," << status.connectionRequests.at(i) << "requests";
+        }
+        logStatistics(modbusTCPMaster->ipv4Address(), status.statistics, status.busUtilization);
+        qCDebug(dcModbusCommander()) << modbusTCPMaster->ipv4Address() << status.reconnectAttempts << "reconnect attempts, backoff" << status.reconnectBackoff << "ms, last reconnect took" << status.reconnectTime << "ms";
+        uint cycleTime = m_pollCycleMonitor.averageCycleTime(modbus);
+        qCDebug(dcModbusCommander()) << modbusTCPMaster->ipv4Address() << "effective cycle time" << cycleTime << "ms," << m_pollCycleMonitor.overruns(modbus) << "polls skipped," << m_pollCycleMonitor.freshSkips(modbus) << "polls of fresh values skipped," << m_pollCycleMonitor.outstandingPolls(modbus) << "polls outstanding";
+        m_pollCycleMonitor.resetCycleTimeStatistics(modbus);
+        foreach (Device *device, m_masterParents.values(modbus)) {
+            setStatisticsStates(device, status.statistics, status.busUtilization);
+            setReconnectStates(device, status);
+            setUnavailableSlavesState(device, status);
+            device->setStateValue(modbusTCPClientPollOverrunsStateTypeId, m_pollCycleMonitor.overruns(modbus));
+            device->setStateValue(modbusTCPClientCycleTimeStateTypeId, cycleTime);
+            device->setStateValue(modbusTCPClientQueueWaitTimeStateTypeId, status.averageQueueWaitTime);
+            device->setStateValue(modbusTCPClientRequestsInFlightStateTypeId, status.peakInFlight);
+            device->setStateValue(modbusTCPClientConnectionUtilizationStateTypeId, utilization.join(" / "));
         }
     }
 }
@@ -288,18 +901,19 @@ void DevicePluginModbusCommander::onRefreshTimer()
 void DevicePluginModbusCommander::onPluginConfigurationChanged(const ParamTypeId &paramTypeId, const QVariant &value)
 {
     // Check refresh schedule
-    if (paramTypeId == modbusCommanderPluginUpdateIntervalParamTypeId) {;
-        if (m_refreshTimer) {
-            uint refreshTime = value.toUInt();
-            m_refreshTimer->stop();
-            m_refreshTimer->startTimer(refreshTime);
-        }
+    if (paramTypeId == modbusCommanderPluginUpdateIntervalParamTypeId) {
+        Q_UNUSED(value)
+        schedulePollPlan();
+    } else if (paramTypeId == modbusCommanderPluginStartupRampParamTypeId) {
+        m_startupSequencer->setRamp(value.toUInt() * 1000);
     }
 }
 
-void DevicePluginModbusCommander::onConnectionStateChanged(bool status)
+void DevicePluginModbusCommander::onConnectionStateChanged(QObject *modbus, bool status)
 {
-    auto modbus = sender();
+    // Results still queued for a master removed in the meantime
+    if (!m_masterParents.contains(modbus))
+        return;
 
     if (m_asyncRTUSetup.contains(static_cast<ModbusRTUMaster *>(modbus))) {
         DeviceSetupInfo *info = m_asyncRTUSetup.take(static_cast<ModbusRTUMaster *>(modbus));
@@ -310,16 +924,34 @@ void DevicePluginModbusCommander::onConnectionStateChanged(bool status)
         info->finish(Device::DeviceErrorNoError);
     }
 
-    if (m_modbusRTUMasters.values().contains(static_cast<ModbusRTUMaster *>(modbus))) {
-        Device *device = m_modbusRTUMasters.key(static_cast<ModbusRTUMaster *>(modbus));
-        device->setStateValue(modbusRTUClientConnectedStateTypeId, status);
-    } else if (m_modbusTCPMasters.values().contains(static_cast<ModbusTCPMaster *>(modbus))) {
-        Device *device = m_modbusTCPMasters.key(static_cast<ModbusTCPMaster *>(modbus));
-        device->setStateValue(modbusTCPClientConnectedStateTypeId, status);
+    // A pooled master reports every connection of the pool, its ramp only restarts when it comes back
+    if (m_startupSequencer->isConnected(modbus) != status)
+        m_startupSequencer->setConnected(modbus, status);
+
+    // Points of a lost connection come back online in waves once it is up again
+    if (!status) {
+        for (QHash<Device *, PollPointKey>::const_iterator it = m_pointKeys.constBegin(); it != m_pointKeys.constEnd(); ++it) {
+            if (it.value().master != modbus)
+                continue;
+
+            Device *device = it.key();
+            setConnectedState(device, false);
+            if (m_staleStateTypeId.contains(device->deviceClassId()))
+                device->setStateValue(m_staleStateTypeId.value(device->deviceClassId()), true);
+            m_startupSequencer->addPoint(modbus, device, lastUpdate(device));
+        }
+    }
+
+    foreach (Device *device, m_masterParents.values(modbus)) {
+        if (device->deviceClassId() == modbusRTUClientDeviceClassId) {
+            device->setStateValue(modbusRTUClientConnectedStateTypeId, status);
+        } else if (device->deviceClassId() == modbusTCPClientDeviceClassId) {
+            device->setStateValue(modbusTCPClientConnectedStateTypeId, status);
+        }
     }
 }
 
-void DevicePluginModbusCommander::onRequestExecuted(QUuid requestId, bool success)
+void DevicePluginModbusCommander::onRequestExecuted(ModbusRequestId requestId, bool success)
 {
     if (m_asyncActions.contains(requestId)){
         DeviceActionInfo *info = m_asyncActions.take(requestId);
@@ -332,12 +964,13 @@ void DevicePluginModbusCommander::onRequestExecuted(QUuid requestId, bool succes
     }
 
     if (m_readRequests.contains(requestId)){
-        Device *device = m_readRequests.take(requestId);
-        device->setStateValue(m_connectedStateTypeId.value(device->deviceClassId()), success);
+        foreach (Device *device, finishRead(requestId)) {
+            setConnectedState(device, success);
+        }
     }
 }
 
-void DevicePluginModbusCommander::onRequestError(QUuid requestId, const QString &error)
+void DevicePluginModbusCommander::onRequestError(ModbusRequestId requestId, const QString &error)
 {
     if (m_asyncActions.contains(requestId)){
         DeviceActionInfo *info = m_asyncActions.take(requestId);
@@ -346,185 +979,344 @@ void DevicePluginModbusCommander::onRequestError(QUuid requestId, const QString
     }
 
     if (m_readRequests.contains(requestId)){
-        Device *device = m_readRequests.take(requestId);
-        device->setStateValue(m_connectedStateTypeId.value(device->deviceClassId()), false);
+        foreach (Device *device, finishRead(requestId)) {
+            setConnectedState(device, false);
+        }
     }
 }
 
-void DevicePluginModbusCommander::onReceivedCoil(quint32 slaveAddress, quint32 modbusRegister, bool value)
+void DevicePluginModbusCommander::onReceivedValues(QObject *modbus, uint slaveAddress, const QModbusDataUnit &dataUnit)
 {
-    auto modbus = sender();
+    if (!m_masterParents.contains(modbus))
+        return;
 
-    if (m_modbusRTUMasters.values().contains(static_cast<ModbusRTUMaster *>(modbus))) {
-        Device *parentDevice = m_modbusRTUMasters.key(static_cast<ModbusRTUMaster *>(modbus));
-        foreach (Device *device, myDevices().filterByParentDeviceId(parentDevice->id())) {
-            if (device->deviceClassId() == coilDeviceClassId) {
-                if ((device->paramValue(m_slaveAddressParamTypeId.value(device->deviceClassId())) == slaveAddress)
-                        && (device->paramValue(m_registerAddressParamTypeId.value(device->deviceClassId())) == modbusRegister)) {
-                    device->setStateValue(m_valueStateTypeId.value(device->deviceClassId()), value);
-                    device->setStateValue(m_connectedStateTypeId.value(device->deviceClassId()), true);
-                    return;
-                }
+    setReceivedValues(modbus, dataUnit.registerType(), slaveAddress, static_cast<uint>(dataUnit.startAddress()), dataUnit.values());
+}
+
+void DevicePluginModbusCommander::setReceivedValues(QObject *modbus, QModbusDataUnit::RegisterType registerType, uint slaveAddress, uint startAddress, const QVector<quint16> &values)
+{
+    // A block read answers many child devices at once, hand each one its own register
+    bool bitRegister = (registerType == QModbusDataUnit::RegisterType::Coils) || (registerType == QModbusDataUnit::RegisterType::DiscreteInputs);
+    qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
+    for (int i = 0; i < values.count(); i++) {
+        PollPointKey key(modbus, slaveAddress, registerType, startAddress + i);
+        uint freshness = 0;
+        QMultiHash<PollPointKey, Device *>::const_iterator it = m_pointIndex.constFind(key);
+        while (it != m_pointIndex.constEnd() && it.key() == key) {
+            Device *device = it.value();
+            setConnectedState(device, true);
+
+            // Values spread over several registers are only taken from responses covering all of them
+            int count = static_cast<int>(registerCount(device));
+            if (i + count > values.count()) {
+                ++it;
+                continue;
             }
-        }
-    } else if (m_modbusTCPMasters.values().contains(static_cast<ModbusTCPMaster *>(modbus))) {
-        Device *parentDevice = m_modbusTCPMasters.key(static_cast<ModbusTCPMaster *>(modbus));
-        foreach (Device *device, myDevices().filterByParentDeviceId(parentDevice->id())) {
-            if (device->deviceClassId() == coilDeviceClassId) {
-                if ((device->paramValue(m_slaveAddressParamTypeId.value(device->deviceClassId())) == slaveAddress)
-                        && (device->paramValue(m_registerAddressParamTypeId.value(device->deviceClassId())) == modbusRegister)) {
+
+            // The confirmed value saves the next poll if it would follow within three quarters of an interval
+            uint lifetime = pollInterval(device) * 3 / 4;
+            freshness = (freshness == 0) ? lifetime : qMin(freshness, lifetime);
+
+            if (device->deviceClassId() == registerBlockDeviceClassId) {
+                setBlockValues(device, values.mid(i, count));
+            } else if (bitRegister) {
+                // Unchanged readings never reach the state machinery
+                if (m_publishFilter.accept(device, values.at(i)))
+                    device->setStateValue(m_valueStateTypeId.value(device->deviceClassId()), values.at(i) != 0);
+                m_valueCache.setValue(device->id(), values.at(i) != 0 ? 1 : 0, timestamp);
+            } else {
+                // Unchanged readings and readings within the deadband never reach the state machinery
+                double value = RegisterDecoder::decodeValue(dataType(device), byteOrder(device), values.constData() + i) * scale(device);
+                if (m_publishFilter.accept(device, value))
                     device->setStateValue(m_valueStateTypeId.value(device->deviceClassId()), value);
-                    device->setStateValue(m_connectedStateTypeId.value(device->deviceClassId()), true);
-                    return;
-                }
+                m_valueCache.setValue(device->id(), value, timestamp);
             }
+
+            if (m_staleStateTypeId.contains(device->deviceClassId()) && device->stateValue(m_staleStateTypeId.value(device->deviceClassId())).toBool())
+                device->setStateValue(m_staleStateTypeId.value(device->deviceClassId()), false);
+            ++it;
         }
+        if (freshness > 0)
+            m_pollCycleMonitor.setFresh(key, freshness);
     }
 }
 
-void DevicePluginModbusCommander::onReceivedDiscreteInput(quint32 slaveAddress, quint32 modbusRegister, bool value)
+QObject *DevicePluginModbusCommander::modbusMaster(Device *parentDevice) const
 {
-    auto modbus = sender();
+    if (!parentDevice)
+        return nullptr;
 
-    if (m_modbusRTUMasters.values().contains(static_cast<ModbusRTUMaster *>(modbus))) {
-        Device *parentDevice = m_modbusRTUMasters.key(static_cast<ModbusRTUMaster *>(modbus));
-        foreach (Device *device, myDevices().filterByParentDeviceId(parentDevice->id())) {
-            if (device->deviceClassId() == discreteInputDeviceClassId) {
-                if ((device->paramValue(m_slaveAddressParamTypeId.value(device->deviceClassId())) == slaveAddress)
-                        && (device->paramValue(m_registerAddressParamTypeId.value(device->deviceClassId())) == modbusRegister)) {
-                    device->setStateValue(m_valueStateTypeId.value(device->deviceClassId()), value);
-                    device->setStateValue(m_connectedStateTypeId.value(device->deviceClassId()), true);
-                    return;
-                }
-            }
-        }
-    } else if (m_modbusTCPMasters.values().contains(static_cast<ModbusTCPMaster *>(modbus))) {
-        Device *parentDevice = m_modbusTCPMasters.key(static_cast<ModbusTCPMaster *>(modbus));
-        foreach (Device *device, myDevices().filterByParentDeviceId(parentDevice->id())) {
-            if (device->deviceClassId() == discreteInputDeviceClassId) {
-                if ((device->paramValue(m_slaveAddressParamTypeId.value(device->deviceClassId())) == slaveAddress)
-                        && (device->paramValue(m_registerAddressParamTypeId.value(device->deviceClassId())) == modbusRegister)) {
-                    device->setStateValue(m_valueStateTypeId.value(device->deviceClassId()), value);
-                    device->setStateValue(m_connectedStateTypeId.value(device->deviceClassId()), true);
-                    return;
-                }
-            }
-        }
+    if (parentDevice->deviceClassId() == modbusTCPClientDeviceClassId) {
+        return m_modbusTCPMasters.value(parentDevice);
+    } else if (parentDevice->deviceClassId() == modbusRTUClientDeviceClassId) {
+        return m_modbusRTUMasters.value(parentDevice);
     }
+    return nullptr;
 }
 
-void DevicePluginModbusCommander::onReceivedHoldingRegister(quint32 slaveAddress, quint32 modbusRegister, int value)
+void DevicePluginModbusCommander::addPoint(Device *device)
 {
-    auto modbus = sender();
+    removePoint(device);
 
-    if (m_modbusRTUMasters.values().contains(static_cast<ModbusRTUMaster *>(modbus))) {
-        Device *parentDevice = m_modbusRTUMasters.key(static_cast<ModbusRTUMaster *>(modbus));
-        foreach (Device *device, myDevices().filterByParentDeviceId(parentDevice->id())) {
-            if (device->deviceClassId() == holdingRegisterDeviceClassId) {
-                if ((device->paramValue(m_slaveAddressParamTypeId.value(device->deviceClassId())) == slaveAddress)
-                        && (device->paramValue(m_registerAddressParamTypeId.value(device->deviceClassId())) == modbusRegister)) {
-                    device->setStateValue(m_valueStateTypeId.value(device->deviceClassId()), value);
-                    device->setStateValue(m_connectedStateTypeId.value(device->deviceClassId()), true);
-                    return;
-                }
-            }
-        }
-    } else if (m_modbusTCPMasters.values().contains(static_cast<ModbusTCPMaster *>(modbus))) {
-        Device *parentDevice = m_modbusTCPMasters.key(static_cast<ModbusTCPMaster *>(modbus));
-        foreach (Device *device, myDevices().filterByParentDeviceId(parentDevice->id())) {
-            if (device->deviceClassId() == holdingRegisterDeviceClassId) {
-                if ((device->paramValue(m_slaveAddressParamTypeId.value(device->deviceClassId())) == slaveAddress)
-                        && (device->paramValue(m_registerAddressParamTypeId.value(device->deviceClassId())) == modbusRegister)) {
-                    device->setStateValue(m_valueStateTypeId.value(device->deviceClassId()), value);
-                    device->setStateValue(m_connectedStateTypeId.value(device->deviceClassId()), true);
-                    return;
-                }
-            }
+    QObject *modbus = modbusMaster(myDevices().findById(device->parentId()));
+    if (!modbus)
+        return;
+
+    uint registerAddress = device->paramValue(m_registerAddressParamTypeId.value(device->deviceClassId())).toUInt();
+    uint slaveAddress = device->paramValue(m_slaveAddressParamTypeId.value(device->deviceClassId())).toUInt();
+    QModbusDataUnit::RegisterType registerType = this->registerType(device);
+    uint pollInterval = device->paramValue(m_pollIntervalParamTypeId.value(device->deviceClassId())).toUInt();
+
+    // Register blocks are indexed by their start address only
+    PollPointKey key(modbus, slaveAddress, registerType, registerAddress);
+    m_pointIndex.insert(key, device);
+    m_pointKeys.insert(device, key);
+    m_pollPlanner.addPoint(device, modbus, slaveAddress, registerType, registerAddress, pollInterval, registerCount(device));
+    schedulePollPlan();
+
+    if (!m_minPublishIntervalParamTypeId.contains(device->deviceClassId()))
+        return;
+
+    double deadband = 0;
+    double deadbandPercent = 0;
+    if (device->deviceClassId() == inputRegisterDeviceClassId) {
+        deadband = device->paramValue(inputRegisterDeviceDeadbandParamTypeId).toDouble();
+        deadbandPercent = device->paramValue(inputRegisterDeviceDeadbandPercentParamTypeId).toDouble();
+    } else if (device->deviceClassId() == holdingRegisterDeviceClassId) {
+        deadband = device->paramValue(holdingRegisterDeviceDeadbandParamTypeId).toDouble();
+        deadbandPercent = device->paramValue(holdingRegisterDeviceDeadbandPercentParamTypeId).toDouble();
+    }
+    m_publishFilter.setLimits(device, deadband, deadbandPercent, device->paramValue(m_minPublishIntervalParamTypeId.value(device->deviceClassId())).toUInt());
+}
+
+QModbusDataUnit::RegisterType DevicePluginModbusCommander::registerType(Device *device) const
+{
+    if (device->deviceClassId() == registerBlockDeviceClassId) {
+        QString registerType = device->paramValue(registerBlockDeviceRegisterTypeParamTypeId).toString();
+        if (registerType == "Coil") {
+            return QModbusDataUnit::RegisterType::Coils;
+        } else if (registerType == "Discrete input") {
+            return QModbusDataUnit::RegisterType::DiscreteInputs;
+        } else if (registerType == "Input register") {
+            return QModbusDataUnit::RegisterType::InputRegisters;
         }
+        return QModbusDataUnit::RegisterType::HoldingRegisters;
     }
+    return m_registerType.value(device->deviceClassId(), QModbusDataUnit::RegisterType::Invalid);
 }
 
-void DevicePluginModbusCommander::onReceivedInputRegister(uint slaveAddress, uint modbusRegister, int value)
+uint DevicePluginModbusCommander::registerCount(Device *device) const
 {
-    auto modbus = sender();
+    if (device->deviceClassId() != registerBlockDeviceClassId)
+        return static_cast<uint>(RegisterDecoder::registerCount(dataType(device)));
 
-    if (m_modbusRTUMasters.values().contains(static_cast<ModbusRTUMaster *>(modbus))) {
-        Device *parentDevice = m_modbusRTUMasters.key(static_cast<ModbusRTUMaster *>(modbus));
-        foreach (Device *device, myDevices().filterByParentDeviceId(parentDevice->id())) {
-            if (device->deviceClassId() == inputRegisterDeviceClassId) {
-                if ((device->paramValue(m_slaveAddressParamTypeId.value(device->deviceClassId())) == slaveAddress)
-                        && (device->paramValue(m_registerAddressParamTypeId.value(device->deviceClassId())) == modbusRegister)) {
-                    device->setStateValue(m_valueStateTypeId.value(device->deviceClassId()), value);
-                    device->setStateValue(m_connectedStateTypeId.value(device->deviceClassId()), true);
-                    return;
-                }
-            }
-        }
-    } else if (m_modbusTCPMasters.values().contains(static_cast<ModbusTCPMaster *>(modbus))) {
-        Device *parentDevice = m_modbusTCPMasters.key(static_cast<ModbusTCPMaster *>(modbus));
-        foreach (Device *device, myDevices().filterByParentDeviceId(parentDevice->id())) {
-            if (device->deviceClassId() == inputRegisterDeviceClassId) {
-                if ((device->paramValue(m_slaveAddressParamTypeId.value(device->deviceClassId())) == slaveAddress)
-                        && (device->paramValue(m_registerAddressParamTypeId.value(device->deviceClassId())) == modbusRegister)) {
-                    device->setStateValue(m_valueStateTypeId.value(device->deviceClassId()), value);
-                    device->setStateValue(m_connectedStateTypeId.value(device->deviceClassId()), true);
-                    return;
-                }
-            }
-        }
+    // A block has to fit into a single response frame
+    uint count = device->paramValue(registerBlockDeviceCountParamTypeId).toUInt();
+    return qBound(1u, count, PollPlanner::maxRequestSpan(registerType(device)));
+}
+
+void DevicePluginModbusCommander::setBlockValues(Device *device, const QVector<quint16> &values)
+{
+    QStringList valueStrings;
+    foreach (double value, RegisterDecoder::decode(dataType(device), byteOrder(device), values)) {
+        valueStrings.append(QString::number(value, 'g', 12));
     }
+
+    QString blockValues = valueStrings.join(",");
+    if (device->stateValue(registerBlockValuesStateTypeId).toString() != blockValues)
+        device->setStateValue(registerBlockValuesStateTypeId, blockValues);
 }
 
-void DevicePluginModbusCommander::readRegister(Device *device)
+RegisterDecoder::DataType DevicePluginModbusCommander::dataType(Device *device) const
 {
-    Device *parent = myDevices().findById(device->parentId());
-    if (!parent) {
-        qCWarning(dcModbusCommander()) << "Could not find parent device" << device->name();
+    // Coils and discrete inputs are single bits, they are never combined
+    QModbusDataUnit::RegisterType registerType = this->registerType(device);
+    if (!m_dataTypeParamTypeId.contains(device->deviceClassId())
+            || registerType == QModbusDataUnit::RegisterType::Coils
+            || registerType == QModbusDataUnit::RegisterType::DiscreteInputs) {
+        return RegisterDecoder::DataTypeUInt16;
+    }
+    return RegisterDecoder::dataType(device->paramValue(m_dataTypeParamTypeId.value(device->deviceClassId())).toString());
+}
+
+RegisterDecoder::ByteOrder DevicePluginModbusCommander::byteOrder(Device *device) const
+{
+    if (!m_byteOrderParamTypeId.contains(device->deviceClassId()))
+        return RegisterDecoder::ByteOrderABCD;
+
+    return RegisterDecoder::byteOrder(device->paramValue(m_byteOrderParamTypeId.value(device->deviceClassId())).toString());
+}
+
+double DevicePluginModbusCommander::scale(Device *device) const
+{
+    if (!m_scaleParamTypeId.contains(device->deviceClassId()))
+        return 1;
+
+    // A scale of 0 would make every reading 0 and every write a division by zero
+    double scale = device->paramValue(m_scaleParamTypeId.value(device->deviceClassId())).toDouble();
+    return scale != 0 ? scale : 1;
+}
+
+uint DevicePluginModbusCommander::pollInterval(Device *device) const
+{
+    uint pollInterval = device->paramValue(m_pollIntervalParamTypeId.value(device->deviceClassId())).toUInt();
+    if (pollInterval == 0)
+        return m_pollScheduler->defaultInterval();
+
+    return pollInterval;
+}
+
+void DevicePluginModbusCommander::setConnectedState(Device *device, bool connected)
+{
+    StateTypeId connectedStateTypeId = m_connectedStateTypeId.value(device->deviceClassId());
+    if (device->stateValue(connectedStateTypeId).toBool() != connected)
+        device->setStateValue(connectedStateTypeId, connected);
+}
+
+void DevicePluginModbusCommander::restoreValue(Device *device)
+{
+    if (!m_staleStateTypeId.contains(device->deviceClassId()))
         return;
+
+    // The last known value stands in until the first read refreshes it
+    double value = 0;
+    qint64 timestamp = 0;
+    if (!m_valueCache.value(device->id(), &value, &timestamp))
+        return;
+
+    if ((device->deviceClassId() == coilDeviceClassId) || (device->deviceClassId() == discreteInputDeviceClassId)) {
+        device->setStateValue(m_valueStateTypeId.value(device->deviceClassId()), value != 0);
+    } else {
+        device->setStateValue(m_valueStateTypeId.value(device->deviceClassId()), value);
     }
+    device->setStateValue(m_staleStateTypeId.value(device->deviceClassId()), true);
+}
 
-    uint registerAddress = device->paramValue(m_registerAddressParamTypeId.value(device->deviceClassId())).toUInt();;
-    uint slaveAddress = device->paramValue(m_slaveAddressParamTypeId.value(device->deviceClassId())).toUInt();
+qint64 DevicePluginModbusCommander::lastUpdate(Device *device) const
+{
+    double value = 0;
+    qint64 timestamp = 0;
+    if (!m_valueCache.value(device->id(), &value, &timestamp))
+        return 0;
 
-    QUuid requestId;
+    return timestamp;
+}
 
-    if (parent->deviceClassId() == modbusTCPClientDeviceClassId) {
-        ModbusTCPMaster *modbus = m_modbusTCPMasters.value(parent);
-        if (!modbus)
-            return;
+void DevicePluginModbusCommander::removePoint(Device *device)
+{
+    if (m_pointKeys.contains(device)) {
+        PollPointKey key = m_pointKeys.take(device);
+        m_pointIndex.remove(key, device);
+        if (!m_pointIndex.contains(key))
+            m_pollCycleMonitor.removePoint(key);
+    }
+    m_pollPlanner.removePoint(device);
+    schedulePollPlan();
+}
 
-        if (device->deviceClassId() == coilDeviceClassId) {
-            requestId = modbus->readCoil(slaveAddress, registerAddress);
-        } else if (device->deviceClassId() == discreteInputDeviceClassId) {
-            requestId = modbus->readDiscreteInput(slaveAddress, registerAddress);
-        } else if (device->deviceClassId() == holdingRegisterDeviceClassId) {
-            requestId = modbus->readHoldingRegister(slaveAddress, registerAddress);
-        } else if (device->deviceClassId() == inputRegisterDeviceClassId) {
-            requestId = modbus->readInputRegister(slaveAddress, registerAddress);
+ModbusRequestId DevicePluginModbusCommander::sendReadRequest(QObject *modbus, QModbusDataUnit::RegisterType registerType, uint slaveAddress, uint registerAddress, uint count, ModbusTransaction::Priority priority)
+{
+    if (ModbusTCPMaster *modbusTCPMaster = qobject_cast<ModbusTCPMaster *>(modbus)) {
+        switch (registerType) {
+        case QModbusDataUnit::RegisterType::Coils:
+            return modbusTCPMaster->readCoil(slaveAddress, registerAddress, count, priority);
+        case QModbusDataUnit::RegisterType::DiscreteInputs:
+            return modbusTCPMaster->readDiscreteInput(slaveAddress, registerAddress, count, priority);
+        case QModbusDataUnit::RegisterType::HoldingRegisters:
+            return modbusTCPMaster->readHoldingRegister(slaveAddress, registerAddress, count, priority);
+        case QModbusDataUnit::RegisterType::InputRegisters:
+            return modbusTCPMaster->readInputRegister(slaveAddress, registerAddress, count, priority);
+        default:
+            break;
         }
-    } else if (parent->deviceClassId() == modbusRTUClientDeviceClassId) {
+    } else if (ModbusRTUMaster *modbusRTUMaster = qobject_cast<ModbusRTUMaster *>(modbus)) {
+        switch (registerType) {
+        case QModbusDataUnit::RegisterType::Coils:
+            return modbusRTUMaster->readCoil(slaveAddress, registerAddress, count, priority);
+        case QModbusDataUnit::RegisterType::DiscreteInputs:
+            return modbusRTUMaster->readDiscreteInput(slaveAddress, registerAddress, count, priority);
+        case QModbusDataUnit::RegisterType::HoldingRegisters:
+            return modbusRTUMaster->readHoldingRegister(slaveAddress, registerAddress, count, priority);
+        case QModbusDataUnit::RegisterType::InputRegisters:
+            return modbusRTUMaster->readInputRegister(slaveAddress, registerAddress, count, priority);
+        default:
+            break;
+        }
+    }
+    return 0;
+}
 
-        ModbusRTUMaster *modbus = m_modbusRTUMasters.value(parent);
-        if (!modbus)
-            return;
+QList<Device *> DevicePluginModbusCommander::finishRead(ModbusRequestId requestId)
+{
+    PendingRead read = m_readRequests.take(requestId);
+    if (read.block.master)
+        m_pollCycleMonitor.finishPoll(read.block);
 
-        if (device->deviceClassId() == coilDeviceClassId) {
-            requestId = modbus->readCoil(slaveAddress, registerAddress);
-        } else if (device->deviceClassId() == discreteInputDeviceClassId) {
-            requestId = modbus->readDiscreteInput(slaveAddress, registerAddress);
-        } else if (device->deviceClassId() == holdingRegisterDeviceClassId) {
-            requestId = modbus->readHoldingRegister(slaveAddress, registerAddress);
-        } else if (device->deviceClassId() == inputRegisterDeviceClassId) {
-            requestId = modbus->readInputRegister(slaveAddress, registerAddress);
+    return read.devices;
+}
+
+void DevicePluginModbusCommander::onPointsDue(QObject *modbus, const QList<Device *> &devices)
+{
+    // The points of a wave are read with the blocks of the poll plan they belong to
+    QSet<Device *> dueDevices = devices.toSet();
+    foreach (const PollBlock &block, m_pollPlanner.blocks()) {
+        if (block.master != modbus)
+            continue;
+
+        foreach (Device *device, block.devices) {
+            if (dueDevices.contains(device)) {
+                readBlock(block);
+                break;
+            }
         }
     }
-    if (!requestId.isNull()) {
-        m_readRequests.insert(requestId, device);
-        QTimer::singleShot(5000, this, [requestId, this] {m_readRequests.remove(requestId);});
-    } else {
-        // Request returned without an id
-        device->setStateValue(m_connectedStateTypeId.value(device->deviceClassId()), false);
+}
+
+void DevicePluginModbusCommander::readBlock(const PollBlock &block)
+{
+    // Requests before the connection is up only fail and mark the points disconnected
+    if (!m_startupSequencer->isConnected(block.master))
+        return;
+
+    // Points still waiting for their wave are not read ahead of it
+    bool waiting = true;
+    foreach (Device *device, block.devices) {
+        if (!m_startupSequencer->isWaiting(device)) {
+            waiting = false;
+            break;
+        }
     }
+    if (waiting)
+        return;
+
+    // Values just written or read back don't need to be read again
+    QList<PollPointKey> points;
+    foreach (Device *device, block.devices) {
+        points.append(m_pointKeys.value(device));
+    }
+    if (m_pollCycleMonitor.skipFreshPoll(block.master, points)) {
+        qCDebug(dcModbusCommander()) << "Values are fresh, skipping block of slave" << block.slaveAddress << "starting at" << block.startAddress;
+        return;
+    }
+
+    // Skip the block while its previous poll is outstanding or the master is saturated
+    if (!m_pollCycleMonitor.beginPoll(block)) {
+        qCDebug(dcModbusCommander()) << "Poll cycle overrun, skipping block of slave" << block.slaveAddress << "starting at" << block.startAddress;
+        return;
+    }
+
+    // Points polled faster than the plugin wide interval go ahead of the background sweep
+    ModbusTransaction::Priority priority = ModbusTransaction::PriorityBackground;
+    if (m_pollScheduler->interval(block) < m_pollScheduler->defaultInterval())
+        priority = ModbusTransaction::PriorityTimeCritical;
+
+    // Requests the master refuses fail through onRequestError like any other
+    ModbusRequestId requestId = sendReadRequest(block.master, block.registerType, block.slaveAddress, block.startAddress, block.count, priority);
+    PendingRead read;
+    read.master = block.master;
+    read.block = PollCycleMonitor::blockKey(block);
+    read.devices = block.devices;
+    m_readRequests.insert(requestId, read);
 }
 
 void DevicePluginModbusCommander::writeRegister(Device *device, DeviceActionInfo *info)
@@ -532,41 +1324,53 @@ void DevicePluginModbusCommander::writeRegister(Device *device, DeviceActionInfo
     Device *parent = myDevices().findById(device->parentId());
     if (!parent) {
         qCWarning(dcModbusCommander()) << "Could not find parente device" << device->name();
+        info->finish(Device::DeviceErrorHardwareNotAvailable);
         return;
     }
     uint registerAddress = device->paramValue(m_registerAddressParamTypeId.value(device->deviceClassId())).toUInt();;
     uint slaveAddress = device->paramValue(m_slaveAddressParamTypeId.value(device->deviceClassId())).toUInt();
 
-    QUuid requestId;
+    ModbusRequestId requestId = 0;
     Action action = info->action();
 
     if (parent->deviceClassId() == modbusTCPClientDeviceClassId) {
         ModbusTCPMaster *modbus = m_modbusTCPMasters.value(parent);
-        if (!modbus)
+        if (!modbus) {
+            info->finish(Device::DeviceErrorHardwareNotAvailable);
             return;
+        }
 
         if (device->deviceClassId() == coilDeviceClassId) {
             requestId = modbus->writeCoil(slaveAddress, registerAddress, action.param(coilValueActionValueParamTypeId).value().toBool());
         } else if (device->deviceClassId() == holdingRegisterDeviceClassId) {
-            requestId = modbus->writeHoldingRegister(slaveAddress, registerAddress, action.param(holdingRegisterValueActionValueParamTypeId).value().toUInt());
+            QVector<quint16> values = RegisterDecoder::encode(dataType(device), byteOrder(device), action.param(holdingRegisterValueActionValueParamTypeId).value().toDouble() / scale(device));
+            if (values.count() == 1) {
+                requestId = modbus->writeHoldingRegister(slaveAddress, registerAddress, values.first());
+            } else {
+                requestId = modbus->writeHoldingRegisters(slaveAddress, registerAddress, values);
+            }
         }
 
     } else if (parent->deviceClassId() == modbusRTUClientDeviceClassId) {
         ModbusRTUMaster *modbus = m_modbusRTUMasters.value(parent);
-        if (!modbus)
+        if (!modbus) {
+            info->finish(Device::DeviceErrorHardwareNotAvailable);
             return;
+        }
 
         if (device->deviceClassId() == coilDeviceClassId) {
             requestId = modbus->writeCoil(slaveAddress, registerAddress, action.param(coilValueActionValueParamTypeId).value().toBool());
         } else if (device->deviceClassId() == holdingRegisterDeviceClassId) {
-            requestId = modbus->writeHoldingRegister(slaveAddress, registerAddress, action.param(holdingRegisterValueActionValueParamTypeId).value().toUInt());
+            QVector<quint16> values = RegisterDecoder::encode(dataType(device), byteOrder(device), action.param(holdingRegisterValueActionValueParamTypeId).value().toDouble() / scale(device));
+            if (values.count() == 1) {
+                requestId = modbus->writeHoldingRegister(slaveAddress, registerAddress, values.first());
+            } else {
+                requestId = modbus->writeHoldingRegisters(slaveAddress, registerAddress, values);
+            }
         }
     }
 
-    if (requestId.toString().isNull()){
-        info->finish(Device::DeviceErrorHardwareNotAvailable);
-    } else {
-        m_asyncActions.insert(requestId, info);
-        connect(info, &DeviceActionInfo::aborted, this, [requestId, this] {m_asyncActions.remove(requestId);});
-    }
+    // Requests the master refuses fail through onRequestError like any other
+    m_asyncActions.insert(requestId, info);
+    connect(info, &DeviceActionInfo::aborted, this, [requestId, this] {m_asyncActions.remove(requestId);});
 }
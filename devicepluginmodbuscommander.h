@@ -28,9 +28,19 @@
 #include "plugintimer.h"
 #include "modbustcpmaster.h"
 #include "modbusrtumaster.h"
+#include "modbusresultchannel.h"
+#include "modbusiothreads.h"
+#include "modbusscanner.h"
+#include "pollplanner.h"
+#include "pollscheduler.h"
+#include "startupsequencer.h"
+#include "valuecache.h"
+#include "pollcyclemonitor.h"
+#include "publishfilter.h"
+#include "registerdecoder.h"
+#include "registermap.h"
 
 #include <QSerialPortInfo>
-#include <QUuid>
 
 class DevicePluginModbusCommander : public DevicePlugin
 {
@@ -50,36 +60,109 @@ public:
     void deviceRemoved(Device *device) override;
 
 private:
-    PluginTimer *m_refreshTimer = nullptr;
-
+    // Discoveries time out after 30 s in the device manager, a scan stops a little earlier to hand over its results
+    static const int ScanDeadline = 25000;
+
+    // A read in flight, block is only set for reads issued by the poll scheduler
+    struct PendingRead {
+        QObject *master = nullptr;
+        PollPointKey block;
+        QList<Device *> devices;
+    };
+
+    // Points of a register map import waiting for their setup, and the ones already set up
+    struct RegisterMapImport {
+        uint generation = 0;
+        QSet<PollPointKey> pending;
+        QList<Device *> devices;
+    };
+
+    PluginTimer *m_statusTimer = nullptr;
+    PollScheduler *m_pollScheduler = nullptr;
+    StartupSequencer *m_startupSequencer = nullptr;
+    bool m_pollPlanPending = false;
+
+    ModbusIoThreads m_ioThreads;
     QHash<Device *, ModbusRTUMaster *> m_modbusRTUMasters;
     QHash<Device *, ModbusTCPMaster *> m_modbusTCPMasters;
-    QHash<QUuid, DeviceActionInfo *> m_asyncActions;
-    QHash<QUuid, Device *> m_readRequests;
+    QHash<QObject *, ModbusResultChannel *> m_resultChannels;
+    ModbusRequestTable<DeviceActionInfo *> m_asyncActions;
+    ModbusRequestTable<PendingRead> m_readRequests;
 
     QHash<ModbusRTUMaster *, DeviceSetupInfo *> m_asyncRTUSetup;
     QHash<ModbusTCPMaster *, DeviceSetupInfo *> m_asyncTCPSetup;
 
-    void readRegister(Device *device);
+    PollPlanner m_pollPlanner;
+    PollCycleMonitor m_pollCycleMonitor;
+    PublishFilter m_publishFilter;
+    ValueCache m_valueCache;
+    QMultiHash<PollPointKey, Device *> m_pointIndex;
+    QHash<Device *, PollPointKey> m_pointKeys;
+    QMultiHash<QObject *, Device *> m_masterParents;
+    QHash<DeviceId, RegisterMapImport> m_registerMapImports;
+    uint m_registerMapImportGeneration = 0;
+
+    QObject *modbusMaster(Device *parentDevice) const;
+    void addPoint(Device *device);
+    void removePoint(Device *device);
+    void schedulePollPlan();
+    void connectResultChannel(QObject *modbus, ModbusResultChannel *channel);
+    void warnDifferingMasterParams(Device *device, Device *sharedDevice, const QList<ParamTypeId> &paramTypeIds) const;
+    void scanDevices(DeviceDiscoveryInfo *info);
+    void addScannedDevices(DeviceDiscoveryInfo *info, Device *parentDevice, const QList<ModbusScanner::Range> &ranges);
+    void importRegisterMap(DeviceActionInfo *info);
+    QString registerMapDirectory() const;
+    void finishRegisterMapImport(const DeviceId &parentDeviceId);
+
+    ModbusRequestId sendReadRequest(QObject *modbus, QModbusDataUnit::RegisterType registerType, uint slaveAddress, uint registerAddress, uint count, ModbusTransaction::Priority priority);
+    QList<Device *> finishRead(ModbusRequestId requestId);
     void writeRegister(Device *device, DeviceActionInfo *info);
+    QModbusDataUnit::RegisterType registerType(Device *device) const;
+    uint registerCount(Device *device) const;
+    RegisterDecoder::DataType dataType(Device *device) const;
+    RegisterDecoder::ByteOrder byteOrder(Device *device) const;
+    double scale(Device *device) const;
+    uint pollInterval(Device *device) const;
+    void setConnectedState(Device *device, bool connected);
+    void restoreValue(Device *device);
+    qint64 lastUpdate(Device *device) const;
+    void logStatistics(const QString &name, const ModbusStatistics &statistics, uint busUtilization) const;
+    void setStatisticsStates(Device *device, const ModbusStatistics &statistics, uint busUtilization);
+    void setReconnectStates(Device *device, const ModbusMasterStatus &status);
+    void setUnavailableSlavesState(Device *device, const ModbusMasterStatus &status);
+    void setBlockValues(Device *device, const QVector<quint16> &values);
+    void setReceivedValues(QObject *modbus, QModbusDataUnit::RegisterType registerType, uint slaveAddress, uint startAddress, const QVector<quint16> &values);
 
     QHash<DeviceClassId, ParamTypeId> m_slaveAddressParamTypeId;
     QHash<DeviceClassId, ParamTypeId> m_registerAddressParamTypeId;
     QHash<DeviceClassId, StateTypeId> m_connectedStateTypeId;
     QHash<DeviceClassId, StateTypeId> m_valueStateTypeId;
+    QHash<DeviceClassId, ParamTypeId> m_pollIntervalParamTypeId;
+    QHash<DeviceClassId, ParamTypeId> m_minPublishIntervalParamTypeId;
+    QHash<DeviceClassId, StateTypeId> m_suppressedUpdatesStateTypeId;
+    QHash<DeviceClassId, StateTypeId> m_staleStateTypeId;
+    QHash<DeviceClassId, ParamTypeId> m_dataTypeParamTypeId;
+    QHash<DeviceClassId, ParamTypeId> m_byteOrderParamTypeId;
+    QHash<DeviceClassId, ParamTypeId> m_scaleParamTypeId;
+    QHash<DeviceClassId, QModbusDataUnit::RegisterType> m_registerType;
+    QHash<DeviceClassId, ParamTypeId> m_scanParamTypeId;
+    QHash<DeviceClassId, ParamTypeId> m_firstSlaveAddressParamTypeId;
+    QHash<DeviceClassId, ParamTypeId> m_lastSlaveAddressParamTypeId;
+    QHash<DeviceClassId, ParamTypeId> m_lastRegisterAddressParamTypeId;
 
 private slots:
-    void onRefreshTimer();
+    void onStatusTimer();
+    void onPollPlanChanged();
+    void readBlock(const PollBlock &block);
+    void onPointsDue(QObject *modbus, const QList<Device *> &devices);
 
     void onPluginConfigurationChanged(const ParamTypeId &paramTypeId, const QVariant &value);
 
-    void onConnectionStateChanged(bool status);
-    void onRequestExecuted(QUuid requestId, bool success);
-    void onRequestError(QUuid requestId, const QString &error);
-    void onReceivedCoil(quint32 slaveAddress, quint32 modbusRegister, bool value);
-    void onReceivedDiscreteInput(quint32 slaveAddress, quint32 modbusRegister, bool value);
-    void onReceivedHoldingRegister(quint32 slaveAddress, quint32 modbusRegister, int value);
-    void onReceivedInputRegister(quint32 slaveAddress, quint32 modbusRegister, int value);
+    void onConnectionStateChanged(QObject *modbus, bool status);
+    void onRequestExecuted(ModbusRequestId requestId, bool success);
+    void onRequestError(ModbusRequestId requestId, const QString &error);
+    void onReceivedValues(QObject *modbus, uint slaveAddress, const QModbusDataUnit &dataUnit);
+    void onStatusReported(QObject *modbus, const ModbusMasterStatus &status);
 };
 
 #endif // DEVICEPLUGINMODBUSCOMMANDER_H
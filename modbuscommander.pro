@@ -11,8 +11,46 @@ SOURCES += \
     devicepluginmodbuscommander.cpp \  
     modbustcpmaster.cpp \
     modbusrtumaster.cpp \
+    modbusrequesttable.cpp \
+    modbustransactionqueue.cpp \
+    modbusstatistics.cpp \
+    roundtripestimator.cpp \
+    pollplanner.cpp \
+    pollcyclemonitor.cpp \
+    pollscheduler.cpp \
+    publishfilter.cpp \
+    modbuswritecoalescer.cpp \
+    registerdecoder.cpp \
+    reconnectpolicy.cpp \
+    circuitbreaker.cpp \
+    modbusresultchannel.cpp \
+    modbusiothreads.cpp \
+    modbusscanner.cpp \
+    registermap.cpp \
+    startupsequencer.cpp \
+    valuecache.cpp \
 
 HEADERS += \
     devicepluginmodbuscommander.h \
     modbustcpmaster.h \
     modbusrtumaster.h \
+    modbusrequesttable.h \
+    modbustransactionqueue.h \
+    modbusstatistics.h \
+    roundtripestimator.h \
+    pollplanner.h \
+    pollcyclemonitor.h \
+    pollscheduler.h \
+    publishfilter.h \
+    modbuswritecoalescer.h \
+    registerdecoder.h \
+    reconnectpolicy.h \
+    circuitbreaker.h \
+    modbusmasterstatus.h \
+    spscqueue.h \
+    modbusresultchannel.h \
+    modbusiothreads.h \
+    modbusscanner.h \
+    registermap.h \
+    startupsequencer.h \
+    valuecache.h \
@@ -0,0 +1,108 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "modbusiothreads.h"
+#include "extern-plugininfo.h"
+
+ModbusIoThreads::ModbusIoThreads(int tcpThreadCount) :
+    m_tcpThreadCount(qMax(1, tcpThreadCount))
+{
+}
+
+ModbusIoThreads::~ModbusIoThreads()
+{
+    // Masters are deleted from their own thread while it winds down
+    foreach (QObject *master, m_masters.keys()) {
+        master->deleteLater();
+    }
+    m_masters.clear();
+
+    foreach (QThread *thread, m_serialThreads.values() + m_tcpThreads) {
+        stopThread(thread);
+    }
+}
+
+void ModbusIoThreads::moveToSerialThread(QObject *master, const QString &serialPort)
+{
+    QThread *thread = m_serialThreads.value(serialPort);
+    if (!thread) {
+        thread = startThread(QString("modbus %1").arg(serialPort));
+        m_serialThreads.insert(serialPort, thread);
+    }
+    master->moveToThread(thread);
+    m_masters.insert(master, thread);
+}
+
+void ModbusIoThreads::moveToTcpThread(QObject *master)
+{
+    // The pool grows up to its size before threads are shared
+    QThread *selected = nullptr;
+    if (m_tcpThreads.count() < m_tcpThreadCount) {
+        selected = startThread(QString("modbus tcp %1").arg(m_tcpThreads.count()));
+        m_tcpThreads.append(selected);
+    } else {
+        int selectedLoad = 0;
+        foreach (QThread *thread, m_tcpThreads) {
+            int load = m_masters.keys(thread).count();
+            if (!selected || load < selectedLoad) {
+                selected = thread;
+                selectedLoad = load;
+            }
+        }
+    }
+    master->moveToThread(selected);
+    m_masters.insert(master, selected);
+}
+
+void ModbusIoThreads::removeMaster(QObject *master)
+{
+    if (!master)
+        return;
+
+    QThread *thread = m_masters.take(master);
+    master->deleteLater();
+
+    // The thread of a serial port ends with its master, pool threads are kept
+    QString serialPort = m_serialThreads.key(thread);
+    if (thread && !serialPort.isEmpty() && m_masters.keys(thread).isEmpty()) {
+        m_serialThreads.remove(serialPort);
+        stopThread(thread);
+    }
+}
+
+QThread *ModbusIoThreads::startThread(const QString &name)
+{
+    QThread *thread = new QThread();
+    thread->setObjectName(name);
+    thread->start();
+    qCDebug(dcModbusCommander()) << "Started I/O thread" << name;
+    return thread;
+}
+
+void ModbusIoThreads::stopThread(QThread *thread)
+{
+    // Deferred deletes of the masters are still handled when the event loop of the thread exits
+    qCDebug(dcModbusCommander()) << "Stopping I/O thread" << thread->objectName();
+    thread->quit();
+    thread->wait();
+    delete thread;
+}
@@ -0,0 +1,56 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MODBUSIOTHREADS_H
+#define MODBUSIOTHREADS_H
+
+#include <QObject>
+#include <QThread>
+#include <QHash>
+#include <QList>
+
+// The threads the masters do their bus I/O in. Every serial port gets a thread of its own, so a
+// slow line never holds up another one. TCP masters mostly wait for the network, they share a
+// small pool and go to the thread serving the fewest masters.
+class ModbusIoThreads
+{
+public:
+    explicit ModbusIoThreads(int tcpThreadCount = 2);
+    ~ModbusIoThreads();
+
+    void moveToSerialThread(QObject *master, const QString &serialPort);
+    void moveToTcpThread(QObject *master);
+    void removeMaster(QObject *master);
+
+private:
+    int m_tcpThreadCount;
+    QHash<QString, QThread *> m_serialThreads;
+    QList<QThread *> m_tcpThreads;
+    QHash<QObject *, QThread *> m_masters;
+
+    QThread *startThread(const QString &name);
+    void stopThread(QThread *thread);
+
+    Q_DISABLE_COPY(ModbusIoThreads)
+};
+
+#endif // MODBUSIOTHREADS_H
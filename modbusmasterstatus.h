@@ -0,0 +1,56 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MODBUSMASTERSTATUS_H
+#define MODBUSMASTERSTATUS_H
+
+#include <QList>
+#include <QMetaType>
+
+#include "modbusstatistics.h"
+
+// Snapshot of the load and health of one master. It is taken in the I/O thread of the master
+// and covers the interval since the previous snapshot.
+struct ModbusMasterStatus
+{
+    int pendingRequests = 0;
+    uint averageQueueWaitTime = 0;
+    uint maxQueueWaitTime = 0;
+
+    // Only used by TCP masters, one entry per pooled connection
+    int peakInFlight = 0;
+    int maxInFlight = 0;
+    QList<uint> connectionUtilization;
+    QList<uint> connectionRequests;
+
+    ModbusStatistics statistics;
+    uint busUtilization = 0;
+
+    uint reconnectAttempts = 0;
+    uint reconnectBackoff = 0;
+    uint reconnectTime = 0;
+    QList<uint> unavailableSlaves;
+};
+
+Q_DECLARE_METATYPE(ModbusMasterStatus)
+
+#endif // MODBUSMASTERSTATUS_H
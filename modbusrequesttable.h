@@ -0,0 +1,189 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MODBUSREQUESTTABLE_H
+#define MODBUSREQUESTTABLE_H
+
+#include <QList>
+#include <QVector>
+
+// Request ids are handed out from one monotonic counter shared by all masters, 0 is never used
+typedef quint64 ModbusRequestId;
+
+ModbusRequestId createModbusRequestId();
+
+// Flat table of pending requests. Because ids are monotonic and requests are short lived,
+// the low bits of the id address a slot directly. Ids are shared by all masters, so a slot can
+// still be taken by a long lived request, the id then goes into one of the next few slots.
+// The table only grows if all of them are taken.
+template <typename T>
+class ModbusRequestTable
+{
+public:
+    explicit ModbusRequestTable(int capacity = 64) :
+        m_slots(capacity)
+    {
+        Q_ASSERT_X((capacity & (capacity - 1)) == 0, "ModbusRequestTable", "capacity must be a power of two");
+    }
+
+    int count() const
+    {
+        return m_count;
+    }
+
+    bool contains(ModbusRequestId requestId) const
+    {
+        return slotIndex(requestId) >= 0;
+    }
+
+    T value(ModbusRequestId requestId) const
+    {
+        int slot = slotIndex(requestId);
+        if (slot < 0)
+            return T();
+
+        return m_slots.at(slot).value;
+    }
+
+    T *find(ModbusRequestId requestId)
+    {
+        int slot = slotIndex(requestId);
+        if (slot < 0)
+            return nullptr;
+
+        return &m_slots[slot].value;
+    }
+
+    void insert(ModbusRequestId requestId, const T &value)
+    {
+        Q_ASSERT(requestId != 0);
+        int slot = slotIndex(requestId);
+        if (slot < 0) {
+            while ((slot = freeSlotIndex(requestId)) < 0) {
+                grow();
+            }
+            m_count++;
+        }
+
+        m_slots[slot].requestId = requestId;
+        m_slots[slot].value = value;
+    }
+
+    T take(ModbusRequestId requestId)
+    {
+        int slot = slotIndex(requestId);
+        if (slot < 0)
+            return T();
+
+        T value = m_slots.at(slot).value;
+        m_slots[slot] = Slot();
+        m_count--;
+        return value;
+    }
+
+    bool remove(ModbusRequestId requestId)
+    {
+        int slot = slotIndex(requestId);
+        if (slot < 0)
+            return false;
+
+        m_slots[slot] = Slot();
+        m_count--;
+        return true;
+    }
+
+    QList<ModbusRequestId> keys() const
+    {
+        QList<ModbusRequestId> requestIds;
+        foreach (const Slot &slot, m_slots) {
+            if (slot.requestId != 0)
+                requestIds.append(slot.requestId);
+        }
+        return requestIds;
+    }
+
+private:
+    // Lookups always check the whole window, so freeing a slot never hides the ids behind it
+    static const int MaxProbes = 8;
+
+    struct Slot {
+        ModbusRequestId requestId = 0;
+        T value = T();
+    };
+
+    QVector<Slot> m_slots;
+    int m_count = 0;
+
+    int index(ModbusRequestId requestId, int probe) const
+    {
+        return static_cast<int>((requestId + static_cast<ModbusRequestId>(probe)) & static_cast<ModbusRequestId>(m_slots.count() - 1));
+    }
+
+    int slotIndex(ModbusRequestId requestId) const
+    {
+        if (requestId == 0)
+            return -1;
+
+        for (int probe = 0; probe < MaxProbes && probe < m_slots.count(); probe++) {
+            int slot = index(requestId, probe);
+            if (m_slots.at(slot).requestId == requestId)
+                return slot;
+        }
+        return -1;
+    }
+
+    int freeSlotIndex(ModbusRequestId requestId) const
+    {
+        for (int probe = 0; probe < MaxProbes && probe < m_slots.count(); probe++) {
+            int slot = index(requestId, probe);
+            if (m_slots.at(slot).requestId == 0)
+                return slot;
+        }
+        return -1;
+    }
+
+    void grow()
+    {
+        // Start over at twice the size until every pending id finds a slot in its window
+        QVector<Slot> oldSlots = m_slots;
+        int capacity = oldSlots.count() * 2;
+        bool placed = false;
+        while (!placed) {
+            m_slots = QVector<Slot>(capacity);
+            placed = true;
+            foreach (const Slot &slot, oldSlots) {
+                if (slot.requestId == 0)
+                    continue;
+
+                int index = freeSlotIndex(slot.requestId);
+                if (index < 0) {
+                    placed = false;
+                    capacity *= 2;
+                    break;
+                }
+                m_slots[index] = slot;
+            }
+        }
+    }
+};
+
+#endif // MODBUSREQUESTTABLE_H
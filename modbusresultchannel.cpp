@@ -0,0 +1,139 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "modbusresultchannel.h"
+#include "modbustcpmaster.h"
+#include "modbusrtumaster.h"
+
+ModbusResultChannel::ModbusResultChannel(ModbusTCPMaster *master, QObject *parent) :
+    QObject(parent),
+    m_master(master),
+    m_drainPending(false)
+{
+    attach(master);
+}
+
+ModbusResultChannel::ModbusResultChannel(ModbusRTUMaster *master, QObject *parent) :
+    QObject(parent),
+    m_master(master),
+    m_drainPending(false)
+{
+    attach(master);
+}
+
+template <typename Master>
+void ModbusResultChannel::attach(Master *master)
+{
+    // These run in the thread of the master, nothing but the queue is touched there
+    connect(master, &Master::connectionStateChanged, this, [this](bool connected) {
+        Result result;
+        result.type = Result::TypeConnectionState;
+        result.success = connected;
+        push(result);
+    }, Qt::DirectConnection);
+    connect(master, &Master::requestExecuted, this, [this](ModbusRequestId requestId, bool success) {
+        Result result;
+        result.type = Result::TypeRequestExecuted;
+        result.requestId = requestId;
+        result.success = success;
+        push(result);
+    }, Qt::DirectConnection);
+    connect(master, &Master::requestError, this, [this](ModbusRequestId requestId, const QString &error) {
+        Result result;
+        result.type = Result::TypeRequestError;
+        result.requestId = requestId;
+        result.error = error;
+        push(result);
+    }, Qt::DirectConnection);
+    connect(master, &Master::exceptionResponse, this, [this](ModbusRequestId requestId, int exceptionCode) {
+        Result result;
+        result.type = Result::TypeExceptionResponse;
+        result.requestId = requestId;
+        result.exceptionCode = exceptionCode;
+        push(result);
+    }, Qt::DirectConnection);
+    connect(master, &Master::receivedCoils, this, [this](uint slaveAddress, uint startAddress, const QVector<quint16> &values) {
+        pushValues(QModbusDataUnit::RegisterType::Coils, slaveAddress, startAddress, values);
+    }, Qt::DirectConnection);
+    connect(master, &Master::receivedDiscreteInputs, this, [this](uint slaveAddress, uint startAddress, const QVector<quint16> &values) {
+        pushValues(QModbusDataUnit::RegisterType::DiscreteInputs, slaveAddress, startAddress, values);
+    }, Qt::DirectConnection);
+    connect(master, &Master::receivedHoldingRegisters, this, [this](uint slaveAddress, uint startAddress, const QVector<quint16> &values) {
+        pushValues(QModbusDataUnit::RegisterType::HoldingRegisters, slaveAddress, startAddress, values);
+    }, Qt::DirectConnection);
+    connect(master, &Master::receivedInputRegisters, this, [this](uint slaveAddress, uint startAddress, const QVector<quint16> &values) {
+        pushValues(QModbusDataUnit::RegisterType::InputRegisters, slaveAddress, startAddress, values);
+    }, Qt::DirectConnection);
+
+    // Status reports come once in a while only, they take the regular queued way
+    connect(master, &Master::statusReported, this, [this](const ModbusMasterStatus &status) {
+        emit statusReported(m_master, status);
+    }, Qt::QueuedConnection);
+
+    // Nothing is pushed any more once the master is gone
+    connect(master, &QObject::destroyed, this, &QObject::deleteLater);
+}
+
+void ModbusResultChannel::push(const Result &result)
+{
+    m_results.enqueue(result);
+
+    // Only the first result of a batch wakes up the plugin thread
+    if (!m_drainPending.exchange(true))
+        QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+}
+
+void ModbusResultChannel::pushValues(QModbusDataUnit::RegisterType registerType, uint slaveAddress, uint startAddress, const QVector<quint16> &values)
+{
+    Result result;
+    result.type = Result::TypeReceivedValues;
+    result.slaveAddress = slaveAddress;
+    result.dataUnit = QModbusDataUnit(registerType, static_cast<int>(startAddress), values);
+    push(result);
+}
+
+void ModbusResultChannel::drain()
+{
+    // Cleared first, results pushed while this batch is handled wake up the next one
+    m_drainPending.store(false);
+
+    Result result;
+    while (m_results.dequeue(&result)) {
+        switch (result.type) {
+        case Result::TypeConnectionState:
+            emit connectionStateChanged(m_master, result.success);
+            break;
+        case Result::TypeRequestExecuted:
+            emit requestExecuted(result.requestId, result.success);
+            break;
+        case Result::TypeRequestError:
+            emit requestError(result.requestId, result.error);
+            break;
+        case Result::TypeExceptionResponse:
+            emit exceptionResponse(result.requestId, result.exceptionCode);
+            break;
+        case Result::TypeReceivedValues:
+            emit receivedValues(m_master, result.slaveAddress, result.dataUnit);
+            break;
+        }
+    }
+}
@@ -0,0 +1,87 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MODBUSRESULTCHANNEL_H
+#define MODBUSRESULTCHANNEL_H
+
+#include <QObject>
+#include <QModbusDataUnit>
+#include <atomic>
+
+#include "modbusrequesttable.h"
+#include "modbusmasterstatus.h"
+#include "spscqueue.h"
+
+class ModbusTCPMaster;
+class ModbusRTUMaster;
+
+// Carries the results of a master running in an I/O thread over to the plugin thread. The I/O
+// thread only appends to a lock-free queue, the plugin thread is woken up once per batch and
+// re-emits everything queued so far, in order.
+class ModbusResultChannel : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ModbusResultChannel(ModbusTCPMaster *master, QObject *parent = nullptr);
+    explicit ModbusResultChannel(ModbusRTUMaster *master, QObject *parent = nullptr);
+
+private:
+    struct Result {
+        enum Type {
+            TypeConnectionState,
+            TypeRequestExecuted,
+            TypeRequestError,
+            TypeExceptionResponse,
+            TypeReceivedValues
+        };
+
+        Type type = TypeRequestExecuted;
+        ModbusRequestId requestId = 0;
+        bool success = false;
+        QString error;
+        int exceptionCode = 0;
+        uint slaveAddress = 0;
+        QModbusDataUnit dataUnit;
+    };
+
+    QObject *m_master = nullptr;
+    SpscQueue<Result> m_results;
+    std::atomic<bool> m_drainPending;
+
+    template <typename Master>
+    void attach(Master *master);
+    void push(const Result &result);
+    void pushValues(QModbusDataUnit::RegisterType registerType, uint slaveAddress, uint startAddress, const QVector<quint16> &values);
+
+private slots:
+    void drain();
+
+signals:
+    void connectionStateChanged(QObject *master, bool connected);
+    void requestExecuted(ModbusRequestId requestId, bool success);
+    void requestError(ModbusRequestId requestId, const QString &error);
+    void exceptionResponse(ModbusRequestId requestId, int exceptionCode);
+    void receivedValues(QObject *master, uint slaveAddress, const QModbusDataUnit &dataUnit);
+    void statusReported(QObject *master, const ModbusMasterStatus &status);
+};
+
+#endif // MODBUSRESULTCHANNEL_H
@@ -26,32 +26,54 @@
 #include <QSerialPortInfo>
 
 ModbusRTUMaster::ModbusRTUMaster(QString serialPort, uint baudrate, QSerialPort::Parity parity, uint dataBits, uint stopBits, QObject *parent) :
-    QObject(parent)
+    QObject(parent),
+    m_serialPort(serialPort),
+    m_baudrate(baudrate),
+    m_parity(parity),
+    m_dataBits(dataBits),
+    m_stopBits(stopBits)
 {
+    // Transactions and status reports cross from and to the plugin thread
+    qRegisterMetaType<ModbusTransaction>();
+    qRegisterMetaType<ModbusMasterStatus>();
+
     m_modbusRtuSerialMaster = new QModbusRtuSerialMaster(this);
     m_modbusRtuSerialMaster->setConnectionParameter(QModbusDevice::SerialPortNameParameter, serialPort);
     m_modbusRtuSerialMaster->setConnectionParameter(QModbusDevice::SerialBaudRateParameter, baudrate);
     m_modbusRtuSerialMaster->setConnectionParameter(QModbusDevice::SerialDataBitsParameter, dataBits);
     m_modbusRtuSerialMaster->setConnectionParameter(QModbusDevice::SerialStopBitsParameter, stopBits);
     m_modbusRtuSerialMaster->setConnectionParameter(QModbusDevice::SerialParityParameter, parity);
-    //m_modbusRtuSerialMaster->setTimeout(100);
-    //m_modbusRtuSerialMaster->setNumberOfRetries(1);
+    // The response timeout is set per request from the round trip estimation, a missed response is not repeated
+    m_modbusRtuSerialMaster->setNumberOfRetries(0);
     connect(m_modbusRtuSerialMaster, &QModbusTcpClient::stateChanged, this, &ModbusRTUMaster::onModbusStateChanged);
     connect(m_modbusRtuSerialMaster, &QModbusRtuSerialMaster::errorOccurred, this, &ModbusRTUMaster::onModbusErrorOccurred);
 
     m_reconnectTimer = new QTimer(this);
     m_reconnectTimer->setSingleShot(true);
     connect(m_reconnectTimer, &QTimer::timeout, this, &ModbusRTUMaster::onReconnectTimer);
+
+    m_writeCoalescingTimer = new QTimer(this);
+    m_writeCoalescingTimer->setSingleShot(true);
+    connect(m_writeCoalescingTimer, &QTimer::timeout, this, &ModbusRTUMaster::onWriteCoalescingTimer);
+
+    // Start bit, data bits, parity bit and stop bits of one character on the line, in microseconds
+    uint bitsPerCharacter = 1 + dataBits + (parity == QSerialPort::NoParity ? 0 : 1) + stopBits;
+    m_charTime = bitsPerCharacter * 1000000 / qMax(1u, baudrate);
+    // Frames are separated by 3.5 characters of silence, fixed to 1750 us above 19200 baud
+    m_frameSilence = (baudrate > 19200) ? 1750 : m_charTime * 7 / 2;
+
+    m_clock.start();
 }
 
 
 ModbusRTUMaster::~ModbusRTUMaster()
 {
-    if (!m_modbusRtuSerialMaster) {
+    if (m_modbusRtuSerialMaster) {
+        m_modbusRtuSerialMaster->disconnect(this);
         m_modbusRtuSerialMaster->disconnectDevice();
         m_modbusRtuSerialMaster->deleteLater();
     }
-    if (!m_reconnectTimer) {
+    if (m_reconnectTimer) {
         m_reconnectTimer->stop();
         m_reconnectTimer->deleteLater();
     }
@@ -67,297 +89,451 @@ bool ModbusRTUMaster::connectDevice()
     return m_modbusRtuSerialMaster->connectDevice();
 }
 
-QString ModbusRTUMaster::serialPort()
+QString ModbusRTUMaster::serialPort() const
 {
-    return m_modbusRtuSerialMaster->connectionParameter(QModbusDevice::SerialPortNameParameter).toString();
+    return m_serialPort;
+}
+
+uint ModbusRTUMaster::baudrate() const
+{
+    return m_baudrate;
+}
+
+QSerialPort::Parity ModbusRTUMaster::parity() const
+{
+    return m_parity;
+}
+
+uint ModbusRTUMaster::dataBits() const
+{
+    return m_dataBits;
+}
+
+uint ModbusRTUMaster::stopBits() const
+{
+    return m_stopBits;
 }
 
 void ModbusRTUMaster::onReconnectTimer()
 {
-    if(!m_modbusRtuSerialMaster->connectDevice()) {
-        m_reconnectTimer->start(10000);
+    // A failed open reports the unconnected state right away, which already armed the next attempt
+    if (!m_modbusRtuSerialMaster->connectDevice() && !m_reconnectTimer->isActive()) {
+        m_reconnectTimer->start(static_cast<int>(m_reconnectPolicy.nextDelay()));
     }
 }
 
-QUuid ModbusRTUMaster::readCoil(uint slaveAddress, uint registerAddress)
+ModbusRequestId ModbusRTUMaster::readCoil(uint slaveAddress, uint registerAddress, uint count, ModbusTransaction::Priority priority)
 {
-    if (!m_modbusRtuSerialMaster) {
-        return "";
-    }
-    QUuid requestId = QUuid::createUuid();
+    return readRegisters(QModbusDataUnit::RegisterType::Coils, slaveAddress, registerAddress, count, priority);
+}
 
-    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::Coils, registerAddress, 1);
+ModbusRequestId ModbusRTUMaster::readDiscreteInput(uint slaveAddress, uint registerAddress, uint count, ModbusTransaction::Priority priority)
+{
+    return readRegisters(QModbusDataUnit::RegisterType::DiscreteInputs, slaveAddress, registerAddress, count, priority);
+}
 
-    if (QModbusReply *reply = m_modbusRtuSerialMaster->sendReadRequest(request, slaveAddress)) {
-        if (!reply->isFinished()) {
-            connect(reply, &QModbusReply::finished, this, [reply, requestId, this] {
+ModbusRequestId ModbusRTUMaster::readInputRegister(uint slaveAddress, uint registerAddress, uint count, ModbusTransaction::Priority priority)
+{
+    return readRegisters(QModbusDataUnit::RegisterType::InputRegisters, slaveAddress, registerAddress, count, priority);
+}
 
+ModbusRequestId ModbusRTUMaster::readHoldingRegister(uint slaveAddress, uint registerAddress, uint count, ModbusTransaction::Priority priority)
+{
+    return readRegisters(QModbusDataUnit::RegisterType::HoldingRegisters, slaveAddress, registerAddress, count, priority);
+}
 
-                if (reply->error() == QModbusDevice::NoError) {
-                    requestExecuted(requestId, true);
-                    const QModbusDataUnit unit = reply->result();
-                    uint modbusAddress = unit.startAddress();
-                    emit receivedCoil(reply->serverAddress(), modbusAddress, unit.value(0));
+ModbusRequestId ModbusRTUMaster::writeCoil(uint slaveAddress, uint registerAddress, bool value)
+{
+    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::Coils, registerAddress, 1);
+    request.setValue(0, static_cast<uint16_t>(value));
+    return writeRegisters(request, slaveAddress);
+}
 
-                } else {
-                    requestExecuted(requestId, false);
-                    qCWarning(dcModbusCommander()) << "Read response error:" << reply->error();
-                }
-                reply->deleteLater();
-            });
-            connect(reply, &QModbusReply::errorOccurred, this, [reply, requestId, this] (QModbusDevice::Error error){
+ModbusRequestId ModbusRTUMaster::writeHoldingRegister(uint slaveAddress, uint registerAddress, uint value)
+{
+    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::HoldingRegisters, registerAddress, 1);
+    request.setValue(0, static_cast<uint16_t>(value));
+    return writeRegisters(request, slaveAddress);
+}
 
-                qCWarning(dcModbusCommander()) << "Modbus replay error:" << error;
+ModbusRequestId ModbusRTUMaster::writeHoldingRegisters(uint slaveAddress, uint registerAddress, const QVector<quint16> &values)
+{
+    // Values spread over several registers are written in one request, never coalesced or split
+    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::HoldingRegisters, registerAddress, values);
+    return writeRegisters(request, slaveAddress);
+}
 
-                emit requestError(requestId, reply->errorString());
-                reply->finished(); // To make sure it will be deleted
-            });
-            QTimer::singleShot(200, reply, &QModbusReply::deleteLater);
-        } else {
-            delete reply; // broadcast replies return immediately
-            return "";
-        }
-    } else {
-        qCWarning(dcModbusCommander()) << "Read error: " << m_modbusRtuSerialMaster->errorString();
-        return "";
-    }
-    return requestId;
+uint ModbusRTUMaster::writeCoalescingWindow() const
+{
+    return m_writeCoalescingWindow;
 }
 
-QUuid ModbusRTUMaster::writeCoil(uint slaveAddress, uint registerAddress, bool value)
+void ModbusRTUMaster::setWriteCoalescingWindow(uint window)
 {
-    if (!m_modbusRtuSerialMaster) {
-        return "";
+    m_writeCoalescingWindow = window;
+    if (m_writeCoalescingWindow == 0 && m_writeCoalescingTimer->isActive()) {
+        m_writeCoalescingTimer->stop();
+        onWriteCoalescingTimer();
     }
-    QUuid requestId = QUuid::createUuid();
+}
 
-    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::Coils, registerAddress, 1);
-    request.setValue(0, static_cast<uint16_t>(value));
+int ModbusRTUMaster::queueDepth() const
+{
+    return m_queue.maxDepth();
+}
 
-    if (QModbusReply *reply = m_modbusRtuSerialMaster->sendWriteRequest(request, slaveAddress)) {
-        if (!reply->isFinished()) {
-            connect(reply, &QModbusReply::finished, this, [reply, requestId, this] {
-
-                if (reply->error() == QModbusDevice::NoError) {
-                    requestExecuted(requestId, true);
-                    const QModbusDataUnit unit = reply->result();
-                    uint modbusAddress = unit.startAddress();
-                    emit receivedCoil(reply->serverAddress(), modbusAddress, unit.value(0));
-
-                } else {
-                    requestExecuted(requestId, false);
-                    qCWarning(dcModbusCommander()) << "Read response error:" << reply->error();
-                }
-                reply->deleteLater();
-            });
-            connect(reply, &QModbusReply::errorOccurred, this, [reply, requestId, this] (QModbusDevice::Error error){
-
-                qCWarning(dcModbusCommander()) << "Modbus replay error:" << error;
-                emit requestError(requestId, reply->errorString());
-                reply->finished(); // To make sure it will be deleted
-            });
-            QTimer::singleShot(200, reply, &QModbusReply::deleteLater);
-        } else {
-            delete reply; // broadcast replies return immediately
-            return "";
-        }
-    } else {
-        qCWarning(dcModbusCommander()) << "Read error: " << m_modbusRtuSerialMaster->errorString();
-        return "";
-    }
-    return requestId;
+void ModbusRTUMaster::setQueueDepth(int queueDepth)
+{
+    m_queue.setMaxDepth(queueDepth);
+}
+
+int ModbusRTUMaster::pendingRequests() const
+{
+    return m_queue.count() + (m_currentRequestId != 0 ? 1 : 0);
+}
+
+uint ModbusRTUMaster::averageQueueWaitTime() const
+{
+    return m_queue.averageWaitTime();
+}
+
+uint ModbusRTUMaster::maxQueueWaitTime() const
+{
+    return m_queue.maxWaitTime();
+}
+
+void ModbusRTUMaster::resetStatistics()
+{
+    m_queue.resetWaitTimeStatistics();
+    m_statistics.resetWindow();
+}
+
+const ModbusStatistics &ModbusRTUMaster::statistics() const
+{
+    return m_statistics;
 }
 
-QUuid ModbusRTUMaster::writeHoldingRegister(uint slaveAddress, uint registerAddress, uint value)
+uint ModbusRTUMaster::busUtilization() const
 {
-    if (!m_modbusRtuSerialMaster) {
-        return "";
+    // The line is occupied from sending a request until its response or timeout
+    return m_statistics.utilization();
+}
+
+const ReconnectPolicy &ModbusRTUMaster::reconnectPolicy() const
+{
+    return m_reconnectPolicy;
+}
+
+void ModbusRTUMaster::setCircuitBreaker(uint failureThreshold, uint probeInterval)
+{
+    m_circuitBreaker.setLimits(failureThreshold, probeInterval);
+}
+
+const CircuitBreaker &ModbusRTUMaster::circuitBreaker() const
+{
+    return m_circuitBreaker;
+}
+
+void ModbusRTUMaster::reportStatus()
+{
+    // Taken in the thread of the master, the plugin only gets the copy
+    ModbusMasterStatus status;
+    status.pendingRequests = pendingRequests();
+    status.averageQueueWaitTime = averageQueueWaitTime();
+    status.maxQueueWaitTime = maxQueueWaitTime();
+    status.statistics = m_statistics;
+    status.busUtilization = busUtilization();
+    status.reconnectAttempts = m_reconnectPolicy.reconnectAttempts();
+    status.reconnectBackoff = m_reconnectPolicy.currentBackoff();
+    status.reconnectTime = m_reconnectPolicy.lastReconnectTime();
+    status.unavailableSlaves = m_circuitBreaker.unavailableSlaves();
+    resetStatistics();
+    emit statusReported(status);
+}
+
+uint ModbusRTUMaster::responseTimeout(uint slaveAddress) const
+{
+    return m_roundTripEstimator.timeout(slaveAddress);
+}
+
+uint ModbusRTUMaster::wireTime(const ModbusTransaction &transaction) const
+{
+    // Frame sizes include slave address, function code and CRC
+    const QModbusDataUnit &unit = transaction.dataUnit;
+    bool bits = (unit.registerType() == QModbusDataUnit::Coils || unit.registerType() == QModbusDataUnit::DiscreteInputs);
+    uint count = static_cast<uint>(unit.valueCount());
+    uint byteCount = bits ? (count + 7) / 8 : count * 2;
+
+    uint requestSize = 8;
+    uint responseSize = 8;
+    if (transaction.type == ModbusTransaction::TypeRead) {
+        responseSize = 5 + byteCount;
+    } else if (count > 1) {
+        requestSize = 9 + byteCount;
     }
-    QUuid requestId = QUuid::createUuid();
 
-    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::HoldingRegisters, registerAddress, 1);
-    request.setValue(0, static_cast<uint16_t>(value));
+    uint microseconds = (requestSize + responseSize) * m_charTime + 2 * m_frameSilence;
+    return (microseconds + 999) / 1000;
+}
 
-    if (QModbusReply *reply = m_modbusRtuSerialMaster->sendWriteRequest(request, slaveAddress)) {
-        if (!reply->isFinished()) {
-            connect(reply, &QModbusReply::finished, this, [reply, requestId, this] {
-
-                if (reply->error() == QModbusDevice::NoError) {
-                    requestExecuted(requestId, true);
-                    const QModbusDataUnit unit = reply->result();
-                    uint modbusAddress = unit.startAddress();
-                    emit receivedHoldingRegister(reply->serverAddress(), modbusAddress, unit.value(0));
-
-                } else {
-                    requestExecuted(requestId, false);
-                    qCWarning(dcModbusCommander()) << "Read response error:" << reply->error();
-                }
-                reply->deleteLater();
-            });
-            connect(reply, &QModbusReply::errorOccurred, this, [reply, requestId, this] (QModbusDevice::Error error){
-
-                qCWarning(dcModbusCommander()) << "Modbus replay error:" << error;
-                emit requestError(requestId, reply->errorString());
-                reply->finished(); // To make sure it will be deleted
-            });
-            QTimer::singleShot(200, reply, &QModbusReply::deleteLater);
-        } else {
-            delete reply; // broadcast replies return immediately
-            return "";
-        }
-    } else {
-        qCWarning(dcModbusCommander()) << "Read error: " << m_modbusRtuSerialMaster->errorString();
-        return "";
+ModbusRequestId ModbusRTUMaster::readRegisters(QModbusDataUnit::RegisterType registerType, uint slaveAddress, uint registerAddress, uint count, ModbusTransaction::Priority priority, uint timeout)
+{
+    ModbusTransaction transaction;
+    transaction.type = ModbusTransaction::TypeRead;
+    transaction.priority = priority;
+    transaction.slaveAddress = slaveAddress;
+    transaction.dataUnit = QModbusDataUnit(registerType, registerAddress, count);
+    transaction.timeout = timeout;
+    return postTransaction(transaction);
+}
+
+ModbusRequestId ModbusRTUMaster::writeRegisters(const QModbusDataUnit &request, uint slaveAddress)
+{
+    ModbusTransaction transaction;
+    transaction.type = ModbusTransaction::TypeWrite;
+    transaction.priority = ModbusTransaction::PriorityAction;
+    transaction.slaveAddress = slaveAddress;
+    transaction.dataUnit = request;
+    return postTransaction(transaction);
+}
+
+ModbusRequestId ModbusRTUMaster::postTransaction(ModbusTransaction transaction)
+{
+    // Callable from any thread, the master takes the transaction over in its own thread.
+    // The id is assigned here, so the caller knows it before any result can arrive.
+    transaction.requestId = createModbusRequestId();
+    QMetaObject::invokeMethod(this, "onTransactionPosted", Qt::QueuedConnection, Q_ARG(ModbusTransaction, transaction));
+    return transaction.requestId;
+}
+
+void ModbusRTUMaster::onTransactionPosted(const ModbusTransaction &transaction)
+{
+    // Single writes wait for the coalescing window, the request id stands for the write until the merged transaction finished
+    if (m_writeCoalescingWindow > 0 && transaction.type == ModbusTransaction::TypeWrite && transaction.dataUnit.valueCount() == 1) {
+        m_writeCoalescer.addWrite(transaction.requestId, transaction.slaveAddress, transaction.dataUnit.registerType(), transaction.dataUnit.startAddress(), static_cast<quint16>(transaction.dataUnit.value(0)));
+        if (!m_writeCoalescingTimer->isActive())
+            m_writeCoalescingTimer->start(static_cast<int>(m_writeCoalescingWindow));
+        return;
+    }
+    enqueueTransaction(transaction);
+}
+
+void ModbusRTUMaster::onWriteCoalescingTimer()
+{
+    foreach (const ModbusWriteCoalescer::Write &write, m_writeCoalescer.takeWrites()) {
+        if (write.requestIds.count() > 1)
+            qCDebug(dcModbusCommander()) << "Coalesced" << write.requestIds.count() << "writes to slave" << write.slaveAddress << "into" << write.dataUnit.valueCount() << "values";
+
+        ModbusTransaction transaction;
+        transaction.requestId = createModbusRequestId();
+        transaction.type = ModbusTransaction::TypeWrite;
+        transaction.priority = ModbusTransaction::PriorityAction;
+        transaction.slaveAddress = write.slaveAddress;
+        transaction.dataUnit = write.dataUnit;
+        // Every write merged into the transaction finishes with its result
+        m_coalescedWrites.insert(transaction.requestId, write.requestIds);
+        enqueueTransaction(transaction);
     }
-    return requestId;
 }
 
-QUuid ModbusRTUMaster::readDiscreteInput(uint slaveAddress, uint registerAddress)
+void ModbusRTUMaster::finishRequest(ModbusRequestId requestId, bool success, const QString &error, int exceptionCode)
 {
-    if (!m_modbusRtuSerialMaster) {
-        return "";
+    // Probes are internal, nobody waits for their result
+    if (m_probeRequests.remove(requestId))
+        return;
+
+    // A coalesced write finishes every write merged into it with its own result
+    QList<ModbusRequestId> requestIds;
+    if (m_coalescedWrites.contains(requestId)) {
+        requestIds = m_coalescedWrites.take(requestId);
+    } else {
+        requestIds.append(requestId);
     }
-    QUuid requestId = QUuid::createUuid();
-
-    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::DiscreteInputs, registerAddress, 1);
-
-    if (QModbusReply *reply = m_modbusRtuSerialMaster->sendReadRequest(request, slaveAddress)) {
-        if (!reply->isFinished()) {
-            connect(reply, &QModbusReply::finished, this, [reply, requestId, this] {
-
-                if (reply->error() == QModbusDevice::NoError) {
-                    requestExecuted(requestId, true);
-                    const QModbusDataUnit unit = reply->result();
-                    uint modbusAddress = unit.startAddress();
-                    emit receivedDiscreteInput(reply->serverAddress(), modbusAddress, unit.value(0));
-
-                } else {
-                    requestExecuted(requestId, false);
-                    qCWarning(dcModbusCommander()) << "Read response error:" << reply->error();
-                }
-                reply->deleteLater();
-            });
-            connect(reply, &QModbusReply::errorOccurred, this, [reply, requestId, this] (QModbusDevice::Error error){
-
-                qCWarning(dcModbusCommander()) << "Modbus replay error:" << error;
-
-                emit requestError(requestId, reply->errorString());
-                reply->finished(); // To make sure it will be deleted
-            });
-            QTimer::singleShot(200, reply, &QModbusReply::deleteLater);
+
+    foreach (ModbusRequestId id, requestIds) {
+        if (success) {
+            emit requestExecuted(id, true);
         } else {
-            delete reply; // broadcast replies return immediately
-            return "";
+            // An exception response proves the slave is there, the scan relies on it
+            if (exceptionCode != 0)
+                emit exceptionResponse(id, exceptionCode);
+            emit requestError(id, error);
         }
-    } else {
-        qCWarning(dcModbusCommander()) << "Read error: " << m_modbusRtuSerialMaster->errorString();
-        return "";
     }
-    return requestId;
 }
 
-QUuid ModbusRTUMaster::readInputRegister(uint slaveAddress, uint registerAddress)
+void ModbusRTUMaster::enqueueTransaction(ModbusTransaction transaction)
 {
-    if (!m_modbusRtuSerialMaster) {
-        return "";
+    if (!m_modbusRtuSerialMaster || m_modbusRtuSerialMaster->state() != QModbusDevice::ConnectedState) {
+        finishRequest(transaction.requestId, false, tr("Device not connected"));
+        return;
     }
-    QUuid requestId = QUuid::createUuid();
 
-    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::InputRegisters, registerAddress, 1);
+    // Requests for a slave that stopped answering are refused, a single register read in their place probes it once in a while
+    if (!m_circuitBreaker.isAvailable(transaction.slaveAddress)) {
+        finishRequest(transaction.requestId, false, tr("Slave not responding"));
+        if (!m_circuitBreaker.startProbe(transaction.slaveAddress))
+            return;
+
+        transaction.requestId = createModbusRequestId();
+        transaction.type = ModbusTransaction::TypeRead;
+        transaction.priority = ModbusTransaction::PriorityTimeCritical;
+        transaction.dataUnit = QModbusDataUnit(transaction.dataUnit.registerType(), transaction.dataUnit.startAddress(), 1);
+        m_probeRequests.insert(transaction.requestId);
+    }
 
-    if (QModbusReply *reply = m_modbusRtuSerialMaster->sendReadRequest(request, slaveAddress)) {
-        if (!reply->isFinished()) {
-            connect(reply, &QModbusReply::finished, this, [reply, requestId, this] {
+    ModbusTransaction evicted;
+    if (!m_queue.enqueue(transaction, &evicted)) {
+        qCWarning(dcModbusCommander()) << "Request queue of" << serialPort() << "is full, dropping request for slave" << transaction.slaveAddress;
+        finishRequest(transaction.requestId, false, tr("Request queue full"));
+        return;
+    }
 
+    if (evicted.requestId != 0) {
+        qCDebug(dcModbusCommander()) << "Request queue of" << serialPort() << "is full, dropped queued request for slave" << evicted.slaveAddress;
+        finishRequest(evicted.requestId, false, tr("Request queue full"));
+    }
 
-                if (reply->error() == QModbusDevice::NoError) {
-                    requestExecuted(requestId, true);
-                    const QModbusDataUnit unit = reply->result();
-                    uint modbusAddress = unit.startAddress();
-                    emit receivedInputRegister(reply->serverAddress(), modbusAddress, unit.value(0));
+    // Send from the event loop, so transactions posted together go out in the order of their priority
+    if (m_currentRequestId == 0)
+        QTimer::singleShot(0, this, &ModbusRTUMaster::sendNextRequest);
+}
 
-                } else {
-                    requestExecuted(requestId, false);
-                    qCWarning(dcModbusCommander()) << "Read response error:" << reply->error();
-                }
-                reply->deleteLater();
-            });
-            connect(reply, &QModbusReply::errorOccurred, this, [reply, requestId, this] (QModbusDevice::Error error){
+void ModbusRTUMaster::sendNextRequest()
+{
+    // The serial line carries one transaction at a time, the next one is sent once the current one finished
+    while (m_currentRequestId == 0 && !m_queue.isEmpty()) {
+        ModbusTransaction transaction = m_queue.dequeue();
+
+        // The slave went out of service while the request was queued
+        if (!m_circuitBreaker.isAvailable(transaction.slaveAddress) && !m_probeRequests.contains(transaction.requestId)) {
+            finishRequest(transaction.requestId, false, tr("Slave not responding"));
+            continue;
+        }
 
-                qCWarning(dcModbusCommander()) << "Modbus replay error:" << error;
+        // The deadline covers both frames on the wire plus the estimated turnaround of the slave
+        uint wireTime = this->wireTime(transaction);
+        uint timeout = transaction.timeout > 0 ? transaction.timeout : m_roundTripEstimator.timeout(transaction.slaveAddress);
+        m_modbusRtuSerialMaster->setTimeout(static_cast<int>(wireTime + timeout));
 
-                emit requestError(requestId, reply->errorString());
-                reply->finished(); // To make sure it will be deleted
-            });
-            QTimer::singleShot(200, reply, &QModbusReply::deleteLater);
+        QModbusReply *reply = nullptr;
+        if (transaction.type == ModbusTransaction::TypeRead) {
+            reply = m_modbusRtuSerialMaster->sendReadRequest(transaction.dataUnit, transaction.slaveAddress);
         } else {
-            delete reply; // broadcast replies return immediately
-            return "";
+            reply = m_modbusRtuSerialMaster->sendWriteRequest(transaction.dataUnit, transaction.slaveAddress);
         }
-    } else {
-        qCWarning(dcModbusCommander()) << "Read error: " << m_modbusRtuSerialMaster->errorString();
-        return "";
+
+        if (!reply) {
+            qCWarning(dcModbusCommander()) << "Send error: " << m_modbusRtuSerialMaster->errorString();
+            finishRequest(transaction.requestId, false, m_modbusRtuSerialMaster->errorString());
+            continue;
+        }
+
+        if (reply->isFinished()) {
+            // broadcast replies return immediately
+            delete reply;
+            finishRequest(transaction.requestId, true);
+            continue;
+        }
+
+        m_currentRequestId = transaction.requestId;
+        ModbusRequestId requestId = transaction.requestId;
+        uint slaveAddress = transaction.slaveAddress;
+        bool estimated = (transaction.timeout == 0);
+        qint64 sendTime = m_clock.elapsed();
+        connect(reply, &QModbusReply::finished, this, [reply, requestId, slaveAddress, estimated, sendTime, wireTime, this] {
+            reply->deleteLater();
+            if (m_currentRequestId == requestId)
+                m_currentRequestId = 0;
+
+            // Only the turnaround of the slave is estimated, the wire time is known from the line parameters
+            qint64 roundTripTime = m_clock.elapsed() - sendTime;
+            // Requests with a deadline of their own, like the probes of a bus scan, say nothing about the slave
+            if (estimated && reply->error() == QModbusDevice::TimeoutError) {
+                m_roundTripEstimator.addTimeout(slaveAddress);
+                m_statistics.addTimeout();
+                if (m_circuitBreaker.addFailure(slaveAddress))
+                    qCWarning(dcModbusCommander()) << "Slave" << slaveAddress << "of" << serialPort() << "stopped responding, suspending its requests";
+            } else if (estimated && (reply->error() == QModbusDevice::NoError || reply->error() == QModbusDevice::ProtocolError)) {
+                m_roundTripEstimator.addSample(slaveAddress, static_cast<uint>(qMax<qint64>(0, roundTripTime - wireTime)));
+                m_statistics.addResponse(static_cast<uint>(roundTripTime));
+                if (reply->error() == QModbusDevice::ProtocolError)
+                    m_statistics.addException(reply->rawResult().exceptionCode());
+                // Exception responses prove the slave is alive as well
+                if (m_circuitBreaker.addResponse(slaveAddress))
+                    qCDebug(dcModbusCommander()) << "Slave" << slaveAddress << "of" << serialPort() << "responds again";
+            }
+            m_statistics.addBusyTime(roundTripTime);
+
+            if (reply->error() == QModbusDevice::NoError) {
+                finishRequest(requestId, true);
+                emitReceivedValues(reply->serverAddress(), reply->result());
+            } else if (!estimated) {
+                // Requests with a deadline of their own, like the short ones of a bus scan, are expected to fail
+                qCDebug(dcModbusCommander()) << "Modbus reply error:" << reply->error() << reply->errorString();
+                finishRequest(requestId, false, reply->errorString(), reply->error() == QModbusDevice::ProtocolError ? reply->rawResult().exceptionCode() : 0);
+            } else {
+                qCWarning(dcModbusCommander()) << "Modbus reply error:" << reply->error() << reply->errorString();
+                finishRequest(requestId, false, reply->errorString(), reply->error() == QModbusDevice::ProtocolError ? reply->rawResult().exceptionCode() : 0);
+            }
+            sendNextRequest();
+        });
     }
-    return requestId;
 }
 
-QUuid ModbusRTUMaster::readHoldingRegister(uint slaveAddress, uint registerAddress)
+void ModbusRTUMaster::emitReceivedValues(uint slaveAddress, const QModbusDataUnit &unit)
 {
-    if (!m_modbusRtuSerialMaster) {
-        return "";
-    }
-    QUuid requestId = QUuid::createUuid();
-
-    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::HoldingRegisters, registerAddress, 1);
-
-    if (QModbusReply *reply = m_modbusRtuSerialMaster->sendReadRequest(request, slaveAddress)) {
-        if (!reply->isFinished()) {
-            connect(reply, &QModbusReply::finished, this, [reply, requestId, this] {
-
-                if (reply->error() == QModbusDevice::NoError) {
-                    requestExecuted(requestId, true);
-                    const QModbusDataUnit unit = reply->result();
-                    uint modbusAddress = unit.startAddress();
-                    emit receivedHoldingRegister(reply->serverAddress(), modbusAddress, unit.value(0));
-
-                } else {
-                    requestExecuted(requestId, false);
-                    qCWarning(dcModbusCommander()) << "Read response error:" << reply->error();
-                }
-                reply->deleteLater();
-            });
-            connect(reply, &QModbusReply::errorOccurred, this, [reply, requestId, this] (QModbusDevice::Error error){
-
-                qCWarning(dcModbusCommander()) << "Modbus replay error:" << error;
-
-                emit requestError(requestId, reply->errorString());
-                reply->finished(); // To make sure it will be deleted
-            });
-            QTimer::singleShot(200, reply, &QModbusReply::deleteLater);
-        } else {
-            delete reply; // broadcast replies return immediately
-            return "";
-        }
-    } else {
-        qCWarning(dcModbusCommander()) << "Read error: " << m_modbusRtuSerialMaster->errorString();
-        return "";
+    // Block reads deliver all registers of the unit at once, the plugin fans them out
+    switch (unit.registerType()) {
+    case QModbusDataUnit::RegisterType::Coils:
+        emit receivedCoils(slaveAddress, unit.startAddress(), unit.values());
+        break;
+    case QModbusDataUnit::RegisterType::DiscreteInputs:
+        emit receivedDiscreteInputs(slaveAddress, unit.startAddress(), unit.values());
+        break;
+    case QModbusDataUnit::RegisterType::HoldingRegisters:
+        emit receivedHoldingRegisters(slaveAddress, unit.startAddress(), unit.values());
+        break;
+    case QModbusDataUnit::RegisterType::InputRegisters:
+        emit receivedInputRegisters(slaveAddress, unit.startAddress(), unit.values());
+        break;
+    default:
+        qCWarning(dcModbusCommander()) << "Received unhandled register type" << unit.registerType();
+        break;
     }
-    return requestId;
 }
 
 
 void ModbusRTUMaster::onModbusErrorOccurred(QModbusDevice::Error error)
 {
     qCWarning(dcModbusCommander()) << "An error occured" << error;
+    // Parity, framing and overrun errors of the serial port are reported as read errors
+    if (error == QModbusDevice::ReadError)
+        m_statistics.addFrameError();
 }
 
 
 void ModbusRTUMaster::onModbusStateChanged(QModbusDevice::State state)
 {
-    bool connected = (state != QModbusDevice::UnconnectedState);
+    // Opening and closing the port are passed through on the way, only the settled states count
+    if (state != QModbusDevice::UnconnectedState && state != QModbusDevice::ConnectedState)
+        return;
+
+    bool connected = (state == QModbusDevice::ConnectedState);
     if (!connected) {
-        //try to reconnect in 10 seconds
-        m_reconnectTimer->start(10000);
+        // Nothing queued can be sent any more
+        foreach (const ModbusTransaction &transaction, m_queue.takeAll()) {
+            finishRequest(transaction.requestId, false, tr("Device disconnected"));
+        }
+        // Retry quickly after a short blip, back off while the port stays unavailable
+        m_reconnectPolicy.disconnected();
+        if (!m_reconnectTimer->isActive())
+            m_reconnectTimer->start(static_cast<int>(m_reconnectPolicy.nextDelay()));
+    } else {
+        m_reconnectPolicy.connected();
+        m_reconnectTimer->stop();
+        // Give every slave a fresh chance on the new connection
+        m_circuitBreaker.clear();
     }
     emit connectionStateChanged(connected);
 }
@@ -27,7 +27,16 @@
 #include <QtSerialBus>
 #include <QSerialPort>
 #include <QTimer>
-#include <QUuid>
+#include <QElapsedTimer>
+#include <QSet>
+#include "modbusrequesttable.h"
+#include "modbustransactionqueue.h"
+#include "roundtripestimator.h"
+#include "modbusstatistics.h"
+#include "modbuswritecoalescer.h"
+#include "reconnectpolicy.h"
+#include "circuitbreaker.h"
+#include "modbusmasterstatus.h"
 
 class ModbusRTUMaster : public QObject
 {
@@ -36,38 +45,100 @@ public:
     explicit ModbusRTUMaster(QString serialPort, uint baudrate, QSerialPort::Parity parity, uint dataBits, uint stopBits, QObject *parent = nullptr);
     ~ModbusRTUMaster();
 
-    bool connectDevice();
+    Q_INVOKABLE bool connectDevice();
+    Q_INVOKABLE void reportStatus();
 
-    QUuid readCoil(uint slaveAddress, uint registerAddress);
-    QUuid readDiscreteInput(uint slaveAddress, uint registerAddress);
-    QUuid readInputRegister(uint slaveAddress, uint registerAddress);
-    QUuid readHoldingRegister(uint slaveAddress, uint registerAddress);
+    ModbusRequestId readCoil(uint slaveAddress, uint registerAddress, uint count = 1, ModbusTransaction::Priority priority = ModbusTransaction::PriorityBackground);
+    ModbusRequestId readDiscreteInput(uint slaveAddress, uint registerAddress, uint count = 1, ModbusTransaction::Priority priority = ModbusTransaction::PriorityBackground);
+    ModbusRequestId readInputRegister(uint slaveAddress, uint registerAddress, uint count = 1, ModbusTransaction::Priority priority = ModbusTransaction::PriorityBackground);
+    ModbusRequestId readHoldingRegister(uint slaveAddress, uint registerAddress, uint count = 1, ModbusTransaction::Priority priority = ModbusTransaction::PriorityBackground);
+    ModbusRequestId readRegisters(QModbusDataUnit::RegisterType registerType, uint slaveAddress, uint registerAddress, uint count, ModbusTransaction::Priority priority, uint timeout = 0);
 
-    QUuid writeCoil(uint slaveAddress, uint registerAddress, bool status);
-    QUuid writeHoldingRegister(uint slaveAddress, uint registerAddress, uint data);
+    ModbusRequestId writeCoil(uint slaveAddress, uint registerAddress, bool status);
+    ModbusRequestId writeHoldingRegister(uint slaveAddress, uint registerAddress, uint data);
+    ModbusRequestId writeHoldingRegisters(uint slaveAddress, uint registerAddress, const QVector<quint16> &values);
 
-    QString serialPort();
+    uint writeCoalescingWindow() const;
+    void setWriteCoalescingWindow(uint window);
+
+    QString serialPort() const;
+    uint baudrate() const;
+    QSerialPort::Parity parity() const;
+    uint dataBits() const;
+    uint stopBits() const;
+
+    int queueDepth() const;
+    void setQueueDepth(int queueDepth);
+    int pendingRequests() const;
+
+    uint averageQueueWaitTime() const;
+    uint maxQueueWaitTime() const;
+    void resetStatistics();
+
+    uint responseTimeout(uint slaveAddress) const;
+    const ModbusStatistics &statistics() const;
+    uint busUtilization() const;
+    const ReconnectPolicy &reconnectPolicy() const;
+
+    void setCircuitBreaker(uint failureThreshold, uint probeInterval);
+    const CircuitBreaker &circuitBreaker() const;
 
 private:
+    // Fixed at construction, so they can be read from any thread
+    QString m_serialPort;
+    uint m_baudrate;
+    QSerialPort::Parity m_parity;
+    uint m_dataBits;
+    uint m_stopBits;
+
     QModbusRtuSerialMaster *m_modbusRtuSerialMaster;
     QTimer *m_reconnectTimer = nullptr;
+    ReconnectPolicy m_reconnectPolicy;
+
+    ModbusTransactionQueue m_queue;
+    ModbusRequestId m_currentRequestId = 0;
+
+    RoundTripEstimator m_roundTripEstimator;
+    ModbusStatistics m_statistics;
+    CircuitBreaker m_circuitBreaker;
+    QSet<ModbusRequestId> m_probeRequests;
+
+    ModbusWriteCoalescer m_writeCoalescer;
+    QTimer *m_writeCoalescingTimer = nullptr;
+    uint m_writeCoalescingWindow = 0;
+    ModbusRequestTable<QList<ModbusRequestId> > m_coalescedWrites;
+    QElapsedTimer m_clock;
+    uint m_charTime = 0;
+    uint m_frameSilence = 0;
+
+    ModbusRequestId writeRegisters(const QModbusDataUnit &request, uint slaveAddress);
+    ModbusRequestId postTransaction(ModbusTransaction transaction);
+    void enqueueTransaction(ModbusTransaction transaction);
+    uint wireTime(const ModbusTransaction &transaction) const;
+    void finishRequest(ModbusRequestId requestId, bool success, const QString &error = QString(), int exceptionCode = 0);
+    void emitReceivedValues(uint slaveAddress, const QModbusDataUnit &unit);
 
 private slots:
+    void onTransactionPosted(const ModbusTransaction &transaction);
     void onReconnectTimer();
+    void onWriteCoalescingTimer();
+    void sendNextRequest();
 
     void onModbusErrorOccurred(QModbusDevice::Error error);
     void onModbusStateChanged(QModbusDevice::State state);
 
 signals:
     void connectionStateChanged(bool status);
+    void statusReported(const ModbusMasterStatus &status);
 
-    void requestExecuted(QUuid requestId, bool success);
-    void requestError(QUuid requestId, const QString &error);
+    void requestExecuted(ModbusRequestId requestId, bool success);
+    void requestError(ModbusRequestId requestId, const QString &error);
+    void exceptionResponse(ModbusRequestId requestId, int exceptionCode);
 
-    void receivedCoil(uint slaveAddress, uint modbusRegister, bool value);
-    void receivedDiscreteInput(uint slaveAddress, uint modbusRegister, bool value);
-    void receivedHoldingRegister(uint slaveAddress, uint modbusRegister, uint value);
-    void receivedInputRegister(uint slaveAddress, uint modbusRegister, uint value);
+    void receivedCoils(uint slaveAddress, uint startAddress, const QVector<quint16> &values);
+    void receivedDiscreteInputs(uint slaveAddress, uint startAddress, const QVector<quint16> &values);
+    void receivedHoldingRegisters(uint slaveAddress, uint startAddress, const QVector<quint16> &values);
+    void receivedInputRegisters(uint slaveAddress, uint startAddress, const QVector<quint16> &values);
 };
 
 #endif // MODBUSRTUMASTER_H
@@ -0,0 +1,244 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "modbusscanner.h"
+#include "modbusresultchannel.h"
+#include "modbustcpmaster.h"
+#include "modbusrtumaster.h"
+#include "pollplanner.h"
+#include "extern-plugininfo.h"
+
+#include <algorithm>
+
+ModbusScanner::ModbusScanner(QObject *master, ModbusResultChannel *channel, QObject *parent) :
+    QObject(parent),
+    m_master(master)
+{
+    m_registerTypes << QModbusDataUnit::RegisterType::Coils << QModbusDataUnit::RegisterType::DiscreteInputs
+                    << QModbusDataUnit::RegisterType::InputRegisters << QModbusDataUnit::RegisterType::HoldingRegisters;
+
+    connect(channel, &ModbusResultChannel::requestExecuted, this, &ModbusScanner::onRequestExecuted);
+    connect(channel, &ModbusResultChannel::requestError, this, &ModbusScanner::onRequestError);
+    connect(channel, &ModbusResultChannel::exceptionResponse, this, &ModbusScanner::onExceptionResponse);
+    // Nothing answers any more once the master is gone, what was found so far is kept
+    connect(channel, &QObject::destroyed, this, [this] {
+        finish();
+    });
+}
+
+void ModbusScanner::setSlaveAddresses(uint firstSlaveAddress, uint lastSlaveAddress)
+{
+    m_firstSlaveAddress = qMax(1u, firstSlaveAddress);
+    m_lastSlaveAddress = qMin(247u, lastSlaveAddress);
+}
+
+void ModbusScanner::setLastRegisterAddress(uint lastRegisterAddress)
+{
+    m_lastRegisterAddress = qMin(65535u, lastRegisterAddress);
+}
+
+void ModbusScanner::setRegisterTypes(const QList<QModbusDataUnit::RegisterType> &registerTypes)
+{
+    m_registerTypes = registerTypes;
+}
+
+void ModbusScanner::setConcurrency(int maxOutstanding)
+{
+    m_maxOutstanding = qMax(1, maxOutstanding);
+}
+
+void ModbusScanner::setTimeout(uint timeout)
+{
+    m_timeout = timeout;
+}
+
+void ModbusScanner::start()
+{
+    // Every slave holds at least one holding register, or answers with an exception
+    for (uint slaveAddress = m_firstSlaveAddress; slaveAddress <= m_lastSlaveAddress; slaveAddress++) {
+        Probe probe;
+        probe.presence = true;
+        probe.slaveAddress = slaveAddress;
+        probe.registerType = QModbusDataUnit::RegisterType::HoldingRegisters;
+        probe.startAddress = 0;
+        probe.count = 1;
+        m_probes.append(probe);
+    }
+    sendProbes();
+}
+
+void ModbusScanner::stop()
+{
+    // Probes still outstanding are abandoned, the slaves found keep the ranges confirmed so far
+    finish();
+}
+
+bool ModbusScanner::isFinished() const
+{
+    return m_finished;
+}
+
+void ModbusScanner::sendProbes()
+{
+    // Probes run side by side up to the concurrency limit, the master pipelines or queues them
+    while (m_outstanding.count() < m_maxOutstanding && !m_probes.isEmpty()) {
+        Probe probe = m_probes.takeFirst();
+        ModbusRequestId requestId = 0;
+        if (ModbusTCPMaster *modbusTCPMaster = qobject_cast<ModbusTCPMaster *>(m_master)) {
+            requestId = modbusTCPMaster->readRegisters(probe.registerType, probe.slaveAddress, probe.startAddress, probe.count, ModbusTransaction::PriorityTimeCritical, m_timeout);
+        } else if (ModbusRTUMaster *modbusRTUMaster = qobject_cast<ModbusRTUMaster *>(m_master)) {
+            requestId = modbusRTUMaster->readRegisters(probe.registerType, probe.slaveAddress, probe.startAddress, probe.count, ModbusTransaction::PriorityTimeCritical, m_timeout);
+        }
+
+        if (requestId != 0)
+            m_outstanding.insert(requestId, probe);
+    }
+
+    if (m_outstanding.isEmpty() && m_probes.isEmpty())
+        finish();
+}
+
+void ModbusScanner::finishProbe(ModbusRequestId requestId, bool answered, bool readable)
+{
+    if (m_finished || !m_outstanding.contains(requestId))
+        return;
+
+    Probe probe = m_outstanding.take(requestId);
+    if (probe.presence) {
+        if (answered) {
+            qCDebug(dcModbusCommander()) << "Scan found slave" << probe.slaveAddress;
+            m_slaveCount++;
+            int &pending = m_pendingProbes[probe.slaveAddress];
+            foreach (QModbusDataUnit::RegisterType registerType, m_registerTypes) {
+                uint span = PollPlanner::maxRequestSpan(registerType);
+                for (uint address = 0; address <= m_lastRegisterAddress; address += span) {
+                    Probe rangeProbe;
+                    rangeProbe.slaveAddress = probe.slaveAddress;
+                    rangeProbe.registerType = registerType;
+                    rangeProbe.startAddress = address;
+                    rangeProbe.count = qMin(span, m_lastRegisterAddress + 1 - address);
+                    m_probes.append(rangeProbe);
+                    pending++;
+                }
+            }
+            if (pending == 0)
+                finishSlave(probe.slaveAddress);
+        }
+        sendProbes();
+        return;
+    }
+
+    int &pending = m_pendingProbes[probe.slaveAddress];
+    pending--;
+    if (readable) {
+        Range range;
+        range.slaveAddress = probe.slaveAddress;
+        range.registerType = probe.registerType;
+        range.startAddress = probe.startAddress;
+        range.count = probe.count;
+        m_slaveRanges[probe.slaveAddress].append(range);
+    } else if (probe.count > 1) {
+        // A refused frame covers at least one unreadable address, the halves are tried on their own
+        QPair<uint, int> key(probe.slaveAddress, static_cast<int>(probe.registerType));
+        if (m_splits.value(key) < MaxSplitsPerType) {
+            m_splits[key]++;
+            Probe lower = probe;
+            lower.count = probe.count / 2;
+            Probe upper = probe;
+            upper.startAddress = probe.startAddress + lower.count;
+            upper.count = probe.count - lower.count;
+            m_probes.prepend(upper);
+            m_probes.prepend(lower);
+            pending += 2;
+        }
+    }
+    if (pending == 0)
+        finishSlave(probe.slaveAddress);
+    sendProbes();
+}
+
+void ModbusScanner::finishSlave(uint slaveAddress)
+{
+    QList<Range> slaveRanges = m_slaveRanges.take(slaveAddress);
+    m_pendingProbes.remove(slaveAddress);
+
+    // Halves found readable one after the other make up one range
+    std::sort(slaveRanges.begin(), slaveRanges.end(), [](const Range &a, const Range &b) {
+        if (a.registerType != b.registerType)
+            return a.registerType < b.registerType;
+        return a.startAddress < b.startAddress;
+    });
+
+    QList<Range> ranges;
+    foreach (const Range &range, slaveRanges) {
+        if (!ranges.isEmpty()) {
+            Range &last = ranges.last();
+            if (last.registerType == range.registerType && last.startAddress + last.count == range.startAddress) {
+                last.count += range.count;
+                continue;
+            }
+        }
+        ranges.append(range);
+    }
+    m_rangeCount += ranges.count();
+
+    qCDebug(dcModbusCommander()) << "Scan of slave" << slaveAddress << "finished with" << ranges.count() << "readable ranges";
+    emit slaveScanned(slaveAddress, ranges);
+}
+
+void ModbusScanner::finish()
+{
+    if (m_finished)
+        return;
+
+    m_finished = true;
+    m_probes.clear();
+    m_outstanding.clear();
+
+    // Slaves interrupted by a stop are reported with what was found of them
+    QList<uint> interrupted = m_pendingProbes.keys();
+    std::sort(interrupted.begin(), interrupted.end());
+    foreach (uint slaveAddress, interrupted) {
+        finishSlave(slaveAddress);
+    }
+
+    qCDebug(dcModbusCommander()) << "Scan finished," << m_slaveCount << "slaves with" << m_rangeCount << "readable ranges";
+    emit finished();
+}
+
+void ModbusScanner::onRequestExecuted(ModbusRequestId requestId, bool success)
+{
+    finishProbe(requestId, success, success);
+}
+
+void ModbusScanner::onRequestError(ModbusRequestId requestId, const QString &error)
+{
+    Q_UNUSED(error)
+    finishProbe(requestId, false, false);
+}
+
+void ModbusScanner::onExceptionResponse(ModbusRequestId requestId, int exceptionCode)
+{
+    Q_UNUSED(exceptionCode)
+    // The error following the exception is no longer outstanding then
+    finishProbe(requestId, true, false);
+}
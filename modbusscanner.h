@@ -0,0 +1,109 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MODBUSSCANNER_H
+#define MODBUSSCANNER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QModbusDataUnit>
+
+#include "modbusrequesttable.h"
+
+class ModbusResultChannel;
+
+// Finds the slaves on a bus and the address ranges they answer. Every slave address is probed
+// with a single register read, an answer or an exception response proves a slave. The address
+// range of each present slave is read in frames as large as possible, a refused frame is split
+// in halves until the readable ranges are narrowed down. Each slave is reported as soon as its
+// ranges are known, a scan stopped early still reports what it found.
+class ModbusScanner : public QObject
+{
+    Q_OBJECT
+public:
+    struct Range {
+        uint slaveAddress = 0;
+        QModbusDataUnit::RegisterType registerType = QModbusDataUnit::Invalid;
+        uint startAddress = 0;
+        uint count = 0;
+    };
+
+    explicit ModbusScanner(QObject *master, ModbusResultChannel *channel, QObject *parent = nullptr);
+
+    void setSlaveAddresses(uint firstSlaveAddress, uint lastSlaveAddress);
+    void setLastRegisterAddress(uint lastRegisterAddress);
+    void setRegisterTypes(const QList<QModbusDataUnit::RegisterType> &registerTypes);
+    void setConcurrency(int maxOutstanding);
+    void setTimeout(uint timeout);
+
+    void start();
+    void stop();
+    bool isFinished() const;
+
+signals:
+    void slaveScanned(uint slaveAddress, const QList<ModbusScanner::Range> &ranges);
+    void finished();
+
+private:
+    // The number of reads narrowing down the ranges of one register type of one slave is limited,
+    // a fully scattered register map would otherwise take a read per address
+    static const int MaxSplitsPerType = 64;
+
+    struct Probe {
+        bool presence = false;
+        uint slaveAddress = 0;
+        QModbusDataUnit::RegisterType registerType = QModbusDataUnit::Invalid;
+        uint startAddress = 0;
+        uint count = 0;
+    };
+
+    QObject *m_master;
+    uint m_firstSlaveAddress = 1;
+    uint m_lastSlaveAddress = 247;
+    uint m_lastRegisterAddress = 255;
+    QList<QModbusDataUnit::RegisterType> m_registerTypes;
+    int m_maxOutstanding = 1;
+    uint m_timeout = 0;
+
+    QList<Probe> m_probes;
+    QHash<ModbusRequestId, Probe> m_outstanding;
+    QHash<QPair<uint, int>, int> m_splits;
+    int m_slaveCount = 0;
+    int m_rangeCount = 0;
+    // Probes still to be answered and the ranges found so far of the slaves being scanned
+    QHash<uint, int> m_pendingProbes;
+    QHash<uint, QList<Range> > m_slaveRanges;
+    bool m_finished = false;
+
+    void sendProbes();
+    void finishProbe(ModbusRequestId requestId, bool answered, bool readable);
+    void finishSlave(uint slaveAddress);
+    void finish();
+
+private slots:
+    void onRequestExecuted(ModbusRequestId requestId, bool success);
+    void onRequestError(ModbusRequestId requestId, const QString &error);
+    void onExceptionResponse(ModbusRequestId requestId, int exceptionCode);
+};
+
+#endif // MODBUSSCANNER_H
@@ -0,0 +1,149 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "modbusstatistics.h"
+
+#include <climits>
+
+// Upper bounds of the round trip time buckets in ms, the last one collects everything slower
+const uint ModbusStatistics::s_bucketLimits[BucketCount] = { 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, UINT_MAX };
+
+ModbusStatistics::ModbusStatistics()
+{
+    m_clock.start();
+    resetWindow();
+}
+
+void ModbusStatistics::addResponse(uint roundTripTime)
+{
+    int bucket = 0;
+    while (roundTripTime > s_bucketLimits[bucket]) {
+        bucket++;
+    }
+    m_histogram[bucket]++;
+    m_requests++;
+    m_roundTripTimeSum += roundTripTime;
+    m_maxRoundTripTime = qMax(m_maxRoundTripTime, roundTripTime);
+}
+
+void ModbusStatistics::addTimeout()
+{
+    m_timeouts++;
+}
+
+void ModbusStatistics::addException(int exceptionCode)
+{
+    m_exceptionCodes[exceptionCode]++;
+}
+
+void ModbusStatistics::addFrameError()
+{
+    m_frameErrors++;
+}
+
+void ModbusStatistics::addBusyTime(qint64 busyTime)
+{
+    m_busyTime += busyTime;
+}
+
+uint ModbusStatistics::requests() const
+{
+    return m_requests;
+}
+
+double ModbusStatistics::requestRate() const
+{
+    qint64 window = m_clock.elapsed() - m_windowStart;
+    if (window <= 0)
+        return 0;
+
+    return m_requests * 1000.0 / window;
+}
+
+uint ModbusStatistics::averageRoundTripTime() const
+{
+    if (m_requests == 0)
+        return 0;
+
+    return static_cast<uint>(m_roundTripTimeSum / m_requests);
+}
+
+uint ModbusStatistics::roundTripTimePercentile(int percentile) const
+{
+    // Resolution is the bucket width, good enough to tell a healthy from a saturated line
+    if (m_requests == 0)
+        return 0;
+
+    uint rank = (m_requests * static_cast<uint>(qBound(0, percentile, 100)) + 99) / 100;
+    uint count = 0;
+    for (int bucket = 0; bucket < BucketCount; bucket++) {
+        count += m_histogram[bucket];
+        if (count >= rank && count > 0)
+            return qMin(s_bucketLimits[bucket], m_maxRoundTripTime);
+    }
+    return m_maxRoundTripTime;
+}
+
+uint ModbusStatistics::utilization() const
+{
+    qint64 window = m_clock.elapsed() - m_windowStart;
+    if (window <= 0)
+        return 0;
+
+    return static_cast<uint>(qMin<qint64>(100, m_busyTime * 100 / window));
+}
+
+uint ModbusStatistics::timeouts() const
+{
+    return m_timeouts;
+}
+
+uint ModbusStatistics::exceptionResponses() const
+{
+    uint exceptionResponses = 0;
+    foreach (uint count, m_exceptionCodes) {
+        exceptionResponses += count;
+    }
+    return exceptionResponses;
+}
+
+QMap<int, uint> ModbusStatistics::exceptionCodes() const
+{
+    return m_exceptionCodes;
+}
+
+uint ModbusStatistics::frameErrors() const
+{
+    return m_frameErrors;
+}
+
+void ModbusStatistics::resetWindow()
+{
+    m_windowStart = m_clock.elapsed();
+    for (int bucket = 0; bucket < BucketCount; bucket++) {
+        m_histogram[bucket] = 0;
+    }
+    m_requests = 0;
+    m_roundTripTimeSum = 0;
+    m_maxRoundTripTime = 0;
+    m_busyTime = 0;
+}
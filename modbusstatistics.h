@@ -0,0 +1,73 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MODBUSSTATISTICS_H
+#define MODBUSSTATISTICS_H
+
+#include <QMap>
+#include <QElapsedTimer>
+
+// Traffic statistics of one master. Error counters run since creation, round trip times,
+// request rate and utilization cover the window since the last resetWindow().
+class ModbusStatistics
+{
+public:
+    ModbusStatistics();
+
+    void addResponse(uint roundTripTime);
+    void addTimeout();
+    void addException(int exceptionCode);
+    void addFrameError();
+    void addBusyTime(qint64 busyTime);
+
+    uint requests() const;
+    double requestRate() const;
+    uint averageRoundTripTime() const;
+    uint roundTripTimePercentile(int percentile) const;
+    uint utilization() const;
+
+    uint timeouts() const;
+    uint exceptionResponses() const;
+    QMap<int, uint> exceptionCodes() const;
+    uint frameErrors() const;
+
+    void resetWindow();
+
+private:
+    static const int BucketCount = 12;
+    static const uint s_bucketLimits[BucketCount];
+
+    QElapsedTimer m_clock;
+    qint64 m_windowStart = 0;
+
+    uint m_histogram[BucketCount];
+    uint m_requests = 0;
+    qint64 m_roundTripTimeSum = 0;
+    uint m_maxRoundTripTime = 0;
+    qint64 m_busyTime = 0;
+
+    uint m_timeouts = 0;
+    QMap<int, uint> m_exceptionCodes;
+    uint m_frameErrors = 0;
+};
+
+#endif // MODBUSSTATISTICS_H
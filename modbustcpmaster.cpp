@@ -23,30 +23,48 @@
 #include "modbustcpmaster.h"
 #include "extern-plugininfo.h"
 
-ModbusTCPMaster::ModbusTCPMaster(QString IPv4Address, uint port, QObject *parent) :
-    QObject(parent)
+ModbusTCPMaster::ModbusTCPMaster(QString IPv4Address, uint port, int poolSize, QObject *parent) :
+    QObject(parent),
+    m_ipv4Address(IPv4Address),
+    m_port(port)
 {
-    m_modbusTcpClient = new QModbusTcpClient(this);
-    m_modbusTcpClient->setConnectionParameter(QModbusDevice::NetworkPortParameter, port);
-    m_modbusTcpClient->setConnectionParameter(QModbusDevice::NetworkAddressParameter, IPv4Address);
-    //m_modbusTcpClient->setTimeout(100);
-    //m_modbusTcpClient->setNumberOfRetries(1);
-
-    connect(m_modbusTcpClient, &QModbusTcpClient::stateChanged, this, &ModbusTCPMaster::onModbusStateChanged);
-    connect(m_modbusTcpClient, &QModbusRtuSerialMaster::errorOccurred, this, &ModbusTCPMaster::onModbusErrorOccurred);
+    // Transactions and status reports cross from and to the plugin thread
+    qRegisterMetaType<ModbusTransaction>();
+    qRegisterMetaType<ModbusMasterStatus>();
+
+    for (int i = 0; i < qMax(1, poolSize); i++) {
+        Connection *connection = new Connection();
+        connection->client = new QModbusTcpClient(this);
+        connection->client->setConnectionParameter(QModbusDevice::NetworkPortParameter, port);
+        connection->client->setConnectionParameter(QModbusDevice::NetworkAddressParameter, IPv4Address);
+        // The response timeout is set per request from the round trip estimation, a missed response is not repeated
+        connection->client->setNumberOfRetries(0);
+
+        connect(connection->client, &QModbusTcpClient::stateChanged, this, &ModbusTCPMaster::onModbusStateChanged);
+        connect(connection->client, &QModbusTcpClient::errorOccurred, this, &ModbusTCPMaster::onModbusErrorOccurred);
+        m_connections.append(connection);
+    }
 
     m_reconnectTimer = new QTimer(this);
     m_reconnectTimer->setSingleShot(true);
     connect(m_reconnectTimer, &QTimer::timeout, this, &ModbusTCPMaster::onReconnectTimer);
+
+    m_writeCoalescingTimer = new QTimer(this);
+    m_writeCoalescingTimer->setSingleShot(true);
+    connect(m_writeCoalescingTimer, &QTimer::timeout, this, &ModbusTCPMaster::onWriteCoalescingTimer);
+
+    m_clock.start();
 }
 
 ModbusTCPMaster::~ModbusTCPMaster()
 {
-    if (!m_modbusTcpClient) {
-        m_modbusTcpClient->disconnectDevice();
-        m_modbusTcpClient->deleteLater();
+    foreach (Connection *connection, m_connections) {
+        connection->client->disconnect(this);
+        connection->client->disconnectDevice();
+        connection->client->deleteLater();
+        delete connection;
     }
-    if (!m_reconnectTimer) {
+    if (m_reconnectTimer) {
         m_reconnectTimer->stop();
         m_reconnectTimer->deleteLater();
     }
@@ -56,312 +74,582 @@ bool ModbusTCPMaster::connectDevice() {
     // TCP connction to target device
     qCDebug(dcModbusCommander()) << "Setting up TCP connecion";
 
-    if (!m_modbusTcpClient)
-        return false;
+    bool success = true;
+    foreach (Connection *connection, m_connections) {
+        if (connection->client->state() == QModbusDevice::UnconnectedState)
+            success &= connection->client->connectDevice();
+    }
+    return success;
+}
 
-    return m_modbusTcpClient->connectDevice();
+uint ModbusTCPMaster::port() const
+{
+    return m_port;
 }
 
-uint ModbusTCPMaster::port()
+void ModbusTCPMaster::onReconnectTimer()
 {
-    return m_modbusTcpClient->connectionParameter(QModbusDevice::NetworkPortParameter).toUInt();
+    // A failed attempt reports the unconnected state right away, which already armed the next attempt
+    if (!connectDevice() && !m_reconnectTimer->isActive()) {
+        m_reconnectTimer->start(static_cast<int>(m_reconnectPolicy.nextDelay()));
+    }
 }
 
-bool ModbusTCPMaster::setIPv4Address(QString ipv4Address)
+QString ModbusTCPMaster::ipv4Address() const
 {
-    m_modbusTcpClient->setConnectionParameter(QModbusDevice::NetworkAddressParameter, ipv4Address);
-    return connectDevice();
+    return m_ipv4Address;
 }
 
-bool ModbusTCPMaster::setPort(uint port)
+ModbusRequestId ModbusTCPMaster::readCoil(uint slaveAddress, uint registerAddress, uint count, ModbusTransaction::Priority priority)
 {
-    m_modbusTcpClient->setConnectionParameter(QModbusDevice::NetworkPortParameter, port);
-    return connectDevice();
+    return readRegisters(QModbusDataUnit::RegisterType::Coils, slaveAddress, registerAddress, count, priority);
 }
 
-void ModbusTCPMaster::onReconnectTimer()
+ModbusRequestId ModbusTCPMaster::readDiscreteInput(uint slaveAddress, uint registerAddress, uint count, ModbusTransaction::Priority priority)
+{
+    return readRegisters(QModbusDataUnit::RegisterType::DiscreteInputs, slaveAddress, registerAddress, count, priority);
+}
+
+ModbusRequestId ModbusTCPMaster::readInputRegister(uint slaveAddress, uint registerAddress, uint count, ModbusTransaction::Priority priority)
+{
+    return readRegisters(QModbusDataUnit::RegisterType::InputRegisters, slaveAddress, registerAddress, count, priority);
+}
+
+ModbusRequestId ModbusTCPMaster::readHoldingRegister(uint slaveAddress, uint registerAddress, uint count, ModbusTransaction::Priority priority)
+{
+    return readRegisters(QModbusDataUnit::RegisterType::HoldingRegisters, slaveAddress, registerAddress, count, priority);
+}
+
+ModbusRequestId ModbusTCPMaster::writeCoil(uint slaveAddress, uint registerAddress, bool value)
+{
+    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::Coils, registerAddress, 1);
+    request.setValue(0, static_cast<uint16_t>(value));
+    return writeRegisters(request, slaveAddress);
+}
+
+ModbusRequestId ModbusTCPMaster::writeHoldingRegister(uint slaveAddress, uint registerAddress, uint value)
+{
+    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::HoldingRegisters, registerAddress, 1);
+    request.setValue(0, static_cast<uint16_t>(value));
+    return writeRegisters(request, slaveAddress);
+}
+
+int ModbusTCPMaster::maxInFlight() const
+{
+    return m_maxInFlight;
+}
+
+void ModbusTCPMaster::setMaxInFlight(int maxInFlight)
+{
+    m_maxInFlight = qMax(1, maxInFlight);
+    QTimer::singleShot(0, this, &ModbusTCPMaster::sendNextRequests);
+}
+
+ModbusRequestId ModbusTCPMaster::writeHoldingRegisters(uint slaveAddress, uint registerAddress, const QVector<quint16> &values)
+{
+    // Values spread over several registers are written in one request, never coalesced or split
+    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::HoldingRegisters, registerAddress, values);
+    return writeRegisters(request, slaveAddress);
+}
+
+uint ModbusTCPMaster::writeCoalescingWindow() const
+{
+    return m_writeCoalescingWindow;
+}
+
+void ModbusTCPMaster::setWriteCoalescingWindow(uint window)
 {
-    if(!m_modbusTcpClient->connectDevice()) {
-        m_reconnectTimer->start(10000);
+    m_writeCoalescingWindow = window;
+    if (m_writeCoalescingWindow == 0 && m_writeCoalescingTimer->isActive()) {
+        m_writeCoalescingTimer->stop();
+        onWriteCoalescingTimer();
     }
 }
 
-QString ModbusTCPMaster::ipv4Address()
+int ModbusTCPMaster::queueDepth() const
 {
-    return m_modbusTcpClient->connectionParameter(QModbusDevice::NetworkAddressParameter).toString();
+    return m_connections.first()->queue.maxDepth();
 }
 
-QUuid ModbusTCPMaster::readCoil(uint slaveAddress, uint registerAddress)
+void ModbusTCPMaster::setQueueDepth(int queueDepth)
 {
-    if (!m_modbusTcpClient) {
-        return "";
+    foreach (Connection *connection, m_connections) {
+        connection->queue.setMaxDepth(queueDepth);
     }
-    QUuid requestId = QUuid::createUuid();
+}
 
-    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::Coils, registerAddress, 1);
+int ModbusTCPMaster::pendingRequests() const
+{
+    int pendingRequests = m_inFlightRequests;
+    foreach (Connection *connection, m_connections) {
+        pendingRequests += connection->queue.count();
+    }
+    return pendingRequests;
+}
 
-    if (QModbusReply *reply = m_modbusTcpClient->sendReadRequest(request, slaveAddress)) {
-        if (!reply->isFinished()) {
-            connect(reply, &QModbusReply::finished, this, [reply, requestId, this] {
-                reply->deleteLater();
-
-                if (reply->error() == QModbusDevice::NoError) {
-                    requestExecuted(requestId, true);
-                    const QModbusDataUnit unit = reply->result();
-                    uint modbusAddress = unit.startAddress();
-                    emit receivedCoil(reply->serverAddress(), modbusAddress, unit.value(0));
-
-                } else {
-                    requestExecuted(requestId, false);
-                    qCWarning(dcModbusCommander()) << "Read response error:" << reply->error();
-                }
-            });
-            connect(reply, &QModbusReply::errorOccurred, this, [reply, requestId, this] (QModbusDevice::Error error){
-
-                qCWarning(dcModbusCommander()) << "Modbus reply error:" << error;
-                emit requestError(requestId, reply->errorString());
-                reply->finished(); // To make sure it will be deleted
-            });
-            QTimer::singleShot(200, reply, &QModbusReply::deleteLater);
-        } else {
-            delete reply; // broadcast replies return immediately
-            return "";
-        }
-    } else {
-        qCWarning(dcModbusCommander()) << "Read error: " << m_modbusTcpClient->errorString();
-        return "";
+int ModbusTCPMaster::peakInFlight() const
+{
+    return m_peakInFlight;
+}
+
+int ModbusTCPMaster::poolSize() const
+{
+    return m_connections.count();
+}
+
+ModbusTCPMaster::PoolStrategy ModbusTCPMaster::poolStrategy() const
+{
+    return m_poolStrategy;
+}
+
+void ModbusTCPMaster::setPoolStrategy(ModbusTCPMaster::PoolStrategy strategy)
+{
+    m_poolStrategy = strategy;
+}
+
+uint ModbusTCPMaster::connectionUtilization(int connection) const
+{
+    // Share of the statistics interval in which the connection had at least one request outstanding, in percent
+    Connection *c = m_connections.value(connection);
+    if (!c)
+        return 0;
+
+    qint64 now = m_clock.elapsed();
+    qint64 interval = now - m_statisticsSince;
+    if (interval <= 0)
+        return 0;
+
+    qint64 busyTime = c->busyTime;
+    if (c->inFlightRequests > 0)
+        busyTime += now - c->busySince;
+
+    return static_cast<uint>(qMin<qint64>(100, busyTime * 100 / interval));
+}
+
+uint ModbusTCPMaster::connectionRequests(int connection) const
+{
+    Connection *c = m_connections.value(connection);
+    if (!c)
+        return 0;
+
+    return c->requestCount;
+}
+
+uint ModbusTCPMaster::averageQueueWaitTime() const
+{
+    qint64 waitTimeSum = 0;
+    uint samples = 0;
+    foreach (Connection *connection, m_connections) {
+        waitTimeSum += static_cast<qint64>(connection->queue.averageWaitTime()) * connection->queue.waitTimeSamples();
+        samples += connection->queue.waitTimeSamples();
     }
-    return requestId;
+    if (samples == 0)
+        return 0;
+
+    return static_cast<uint>(waitTimeSum / samples);
 }
 
-QUuid ModbusTCPMaster::writeHoldingRegister(uint slaveAddress, uint registerAddress, uint value)
+uint ModbusTCPMaster::maxQueueWaitTime() const
 {
-    if (!m_modbusTcpClient) {
-        return "";
+    uint maxWaitTime = 0;
+    foreach (Connection *connection, m_connections) {
+        maxWaitTime = qMax(maxWaitTime, connection->queue.maxWaitTime());
     }
-    QUuid requestId = QUuid::createUuid();
-    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::HoldingRegisters, registerAddress, 1);
-    request.setValue(0, static_cast<uint16_t>(value));
+    return maxWaitTime;
+}
 
-    if (QModbusReply *reply = m_modbusTcpClient->sendWriteRequest(request, slaveAddress)) {
-        if (!reply->isFinished()) {
-            connect(reply, &QModbusReply::finished, this, [reply, requestId, this] {
-
-                if (reply->error() == QModbusDevice::NoError) {
-                    requestExecuted(requestId, true);
-                    const QModbusDataUnit unit = reply->result();
-                    uint modbusAddress = unit.startAddress();
-                    emit receivedHoldingRegister(reply->serverAddress(), modbusAddress, unit.value(0));
-
-                } else {
-                    requestExecuted(requestId, false);
-                    qCWarning(dcModbusCommander()) << "Read response error:" << reply->error();
-                }
-                reply->deleteLater();
-            });
-            connect(reply, &QModbusReply::errorOccurred, this, [reply, requestId, this] (QModbusDevice::Error error){
-
-                qCWarning(dcModbusCommander()) << "Modbus replay error:" << error;
-                emit requestError(requestId, reply->errorString());
-                reply->finished(); // To make sure it will be deleted
-            });
-            QTimer::singleShot(200, reply, &QModbusReply::deleteLater);
-        } else {
-            delete reply; // broadcast replies return immediately
-            return "";
-        }
-    } else {
-        qCWarning(dcModbusCommander()) << "Read error: " << m_modbusTcpClient->errorString();
-        return "";
+const ModbusStatistics &ModbusTCPMaster::statistics() const
+{
+    return m_statistics;
+}
+
+uint ModbusTCPMaster::busUtilization() const
+{
+    uint utilization = 0;
+    for (int i = 0; i < m_connections.count(); i++) {
+        utilization += connectionUtilization(i);
+    }
+    return utilization / static_cast<uint>(m_connections.count());
+}
+
+void ModbusTCPMaster::resetStatistics()
+{
+    qint64 now = m_clock.elapsed();
+    foreach (Connection *connection, m_connections) {
+        connection->queue.resetWaitTimeStatistics();
+        connection->requestCount = 0;
+        connection->busyTime = 0;
+        connection->busySince = now;
+    }
+    m_statisticsSince = now;
+    m_peakInFlight = m_inFlightRequests;
+    m_statistics.resetWindow();
+}
+
+const ReconnectPolicy &ModbusTCPMaster::reconnectPolicy() const
+{
+    return m_reconnectPolicy;
+}
+
+void ModbusTCPMaster::setCircuitBreaker(uint failureThreshold, uint probeInterval)
+{
+    m_circuitBreaker.setLimits(failureThreshold, probeInterval);
+}
+
+const CircuitBreaker &ModbusTCPMaster::circuitBreaker() const
+{
+    return m_circuitBreaker;
+}
+
+void ModbusTCPMaster::reportStatus()
+{
+    // Taken in the thread of the master, the plugin only gets the copy
+    ModbusMasterStatus status;
+    status.pendingRequests = pendingRequests();
+    status.averageQueueWaitTime = averageQueueWaitTime();
+    status.maxQueueWaitTime = maxQueueWaitTime();
+    status.peakInFlight = m_peakInFlight;
+    status.maxInFlight = m_maxInFlight;
+    for (int i = 0; i < m_connections.count(); i++) {
+        status.connectionUtilization.append(connectionUtilization(i));
+        status.connectionRequests.append(connectionRequests(i));
+    }
+    status.statistics = m_statistics;
+    status.busUtilization = busUtilization();
+    status.reconnectAttempts = m_reconnectPolicy.reconnectAttempts();
+    status.reconnectBackoff = m_reconnectPolicy.currentBackoff();
+    status.reconnectTime = m_reconnectPolicy.lastReconnectTime();
+    status.unavailableSlaves = m_circuitBreaker.unavailableSlaves();
+    resetStatistics();
+    emit statusReported(status);
+}
+
+uint ModbusTCPMaster::responseTimeout(uint slaveAddress) const
+{
+    return m_roundTripEstimator.timeout(slaveAddress);
+}
+
+ModbusRequestId ModbusTCPMaster::readRegisters(QModbusDataUnit::RegisterType registerType, uint slaveAddress, uint registerAddress, uint count, ModbusTransaction::Priority priority, uint timeout)
+{
+    ModbusTransaction transaction;
+    transaction.type = ModbusTransaction::TypeRead;
+    transaction.priority = priority;
+    transaction.slaveAddress = slaveAddress;
+    transaction.dataUnit = QModbusDataUnit(registerType, registerAddress, count);
+    transaction.timeout = timeout;
+    return postTransaction(transaction);
+}
+
+ModbusRequestId ModbusTCPMaster::writeRegisters(const QModbusDataUnit &request, uint slaveAddress)
+{
+    ModbusTransaction transaction;
+    transaction.type = ModbusTransaction::TypeWrite;
+    transaction.priority = ModbusTransaction::PriorityAction;
+    transaction.slaveAddress = slaveAddress;
+    transaction.dataUnit = request;
+    return postTransaction(transaction);
+}
+
+ModbusRequestId ModbusTCPMaster::postTransaction(ModbusTransaction transaction)
+{
+    // Callable from any thread, the master takes the transaction over in its own thread.
+    // The id is assigned here, so the caller knows it before any result can arrive.
+    transaction.requestId = createModbusRequestId();
+    QMetaObject::invokeMethod(this, "onTransactionPosted", Qt::QueuedConnection, Q_ARG(ModbusTransaction, transaction));
+    return transaction.requestId;
+}
+
+void ModbusTCPMaster::onTransactionPosted(const ModbusTransaction &transaction)
+{
+    // Single writes wait for the coalescing window, the request id stands for the write until the merged transaction finished
+    if (m_writeCoalescingWindow > 0 && transaction.type == ModbusTransaction::TypeWrite && transaction.dataUnit.valueCount() == 1) {
+        m_writeCoalescer.addWrite(transaction.requestId, transaction.slaveAddress, transaction.dataUnit.registerType(), transaction.dataUnit.startAddress(), static_cast<quint16>(transaction.dataUnit.value(0)));
+        if (!m_writeCoalescingTimer->isActive())
+            m_writeCoalescingTimer->start(static_cast<int>(m_writeCoalescingWindow));
+        return;
+    }
+    enqueueTransaction(transaction);
+}
+
+void ModbusTCPMaster::onWriteCoalescingTimer()
+{
+    foreach (const ModbusWriteCoalescer::Write &write, m_writeCoalescer.takeWrites()) {
+        if (write.requestIds.count() > 1)
+            qCDebug(dcModbusCommander()) << "Coalesced" << write.requestIds.count() << "writes to slave" << write.slaveAddress << "into" << write.dataUnit.valueCount() << "values";
+
+        ModbusTransaction transaction;
+        transaction.requestId = createModbusRequestId();
+        transaction.type = ModbusTransaction::TypeWrite;
+        transaction.priority = ModbusTransaction::PriorityAction;
+        transaction.slaveAddress = write.slaveAddress;
+        transaction.dataUnit = write.dataUnit;
+        // Every write merged into the transaction finishes with its result
+        m_coalescedWrites.insert(transaction.requestId, write.requestIds);
+        enqueueTransaction(transaction);
     }
-    return requestId;
 }
 
-QUuid ModbusTCPMaster::readDiscreteInput(uint slaveAddress, uint registerAddress)
+void ModbusTCPMaster::finishRequest(ModbusRequestId requestId, bool success, const QString &error, int exceptionCode)
 {
-    if (!m_modbusTcpClient) {
-        return "";
+    // Probes are internal, nobody waits for their result
+    if (m_probeRequests.remove(requestId))
+        return;
+
+    // A coalesced write finishes every write merged into it with its own result
+    QList<ModbusRequestId> requestIds;
+    if (m_coalescedWrites.contains(requestId)) {
+        requestIds = m_coalescedWrites.take(requestId);
+    } else {
+        requestIds.append(requestId);
     }
-    QUuid requestId = QUuid::createUuid();
-
-    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::DiscreteInputs, registerAddress, 1);
-
-    if (QModbusReply *reply = m_modbusTcpClient->sendReadRequest(request, slaveAddress)) {
-        if (!reply->isFinished()) {
-            connect(reply, &QModbusReply::finished, this, [reply, requestId, this] {
-                reply->deleteLater();
-                if (reply->error() == QModbusDevice::NoError) {
-                    requestExecuted(requestId, true);
-                    const QModbusDataUnit unit = reply->result();
-                    uint modbusAddress = unit.startAddress();
-                    emit receivedDiscreteInput(reply->serverAddress(), modbusAddress, unit.value(0));
-
-                } else {
-                    requestExecuted(requestId, false);
-                    qCWarning(dcModbusCommander()) << "Read response error:" << reply->error();
-                }
-            });
-            connect(reply, &QModbusReply::errorOccurred, this, [requestId, this] (QModbusDevice::Error error){
-
-                qCWarning(dcModbusCommander()) << "Modbus replay error:" << error;
-                QModbusReply *reply = qobject_cast<QModbusReply *>(sender());
-                emit requestError(requestId, reply->errorString());
-                reply->finished(); // To make sure it will be deleted
-            });
-            QTimer::singleShot(200, reply, &QModbusReply::deleteLater);
+
+    foreach (ModbusRequestId id, requestIds) {
+        if (success) {
+            emit requestExecuted(id, true);
         } else {
-            delete reply; // broadcast replies return immediately
-            return "";
+            // An exception response proves the slave is there, the scan relies on it
+            if (exceptionCode != 0)
+                emit exceptionResponse(id, exceptionCode);
+            emit requestError(id, error);
         }
-    } else {
-        qCWarning(dcModbusCommander()) << "Read error: " << m_modbusTcpClient->errorString();
-        return "";
     }
-    return requestId;
 }
 
-QUuid ModbusTCPMaster::readInputRegister(uint slaveAddress, uint registerAddress)
+int ModbusTCPMaster::selectConnection(uint slaveAddress) const
 {
-    if (!m_modbusTcpClient) {
-        return "";
+    // Gateways serializing per downstream line expect all requests of a slave on the same connection
+    if (m_poolStrategy == PoolStrategySlaveAddress) {
+        int index = static_cast<int>(slaveAddress % static_cast<uint>(m_connections.count()));
+        if (m_connections.at(index)->client->state() == QModbusDevice::ConnectedState)
+            return index;
     }
-    QUuid requestId = QUuid::createUuid();
-
-    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::InputRegisters, registerAddress, 1);
-
-    if (QModbusReply *reply = m_modbusTcpClient->sendReadRequest(request, slaveAddress)) {
-        if (!reply->isFinished()) {
-            connect(reply, &QModbusReply::finished, this, [reply, requestId, this] {
-                reply->deleteLater();
-                if (reply->error() == QModbusDevice::NoError) {
-                    requestExecuted(requestId, true);
-                    const QModbusDataUnit unit = reply->result();
-                    uint modbusAddress = unit.startAddress();
-                    emit receivedInputRegister(reply->serverAddress(), modbusAddress, unit.value(0));
-
-                } else {
-                    requestExecuted(requestId, false);
-                    qCWarning(dcModbusCommander()) << "Read response error:" << reply->error();
-                }
-            });
-            connect(reply, &QModbusReply::errorOccurred, this, [reply, requestId, this] (QModbusDevice::Error error){
-
-                qCWarning(dcModbusCommander()) << "Modbus reply error:" << error;
-                emit requestError(requestId, reply->errorString());
-                reply->finished(); // To make sure it will be deleted
-            });
-            QTimer::singleShot(200, reply, &QModbusReply::deleteLater);
-        } else {
-            delete reply; // broadcast replies return immediately
-            return "";
+
+    int selected = -1;
+    int selectedLoad = 0;
+    for (int i = 0; i < m_connections.count(); i++) {
+        Connection *connection = m_connections.at(i);
+        if (connection->client->state() != QModbusDevice::ConnectedState)
+            continue;
+
+        int load = connection->inFlightRequests + connection->queue.count();
+        if (selected < 0 || load < selectedLoad) {
+            selected = i;
+            selectedLoad = load;
         }
-    } else {
-        qCWarning(dcModbusCommander()) << "Read error: " << m_modbusTcpClient->errorString();
-        return "";
     }
-    return requestId;
+    return selected;
 }
 
-QUuid ModbusTCPMaster::readHoldingRegister(uint slaveAddress, uint registerAddress)
+void ModbusTCPMaster::enqueueTransaction(ModbusTransaction transaction)
 {
-    if (!m_modbusTcpClient) {
-        return "";
+    int index = selectConnection(transaction.slaveAddress);
+    if (index < 0) {
+        finishRequest(transaction.requestId, false, tr("Device not connected"));
+        return;
+    }
+    Connection *connection = m_connections.at(index);
+
+    // Requests for a slave that stopped answering are refused, a single register read in their place probes it once in a while
+    if (!m_circuitBreaker.isAvailable(transaction.slaveAddress)) {
+        finishRequest(transaction.requestId, false, tr("Slave not responding"));
+        if (!m_circuitBreaker.startProbe(transaction.slaveAddress))
+            return;
+
+        transaction.requestId = createModbusRequestId();
+        transaction.type = ModbusTransaction::TypeRead;
+        transaction.priority = ModbusTransaction::PriorityTimeCritical;
+        transaction.dataUnit = QModbusDataUnit(transaction.dataUnit.registerType(), transaction.dataUnit.startAddress(), 1);
+        m_probeRequests.insert(transaction.requestId);
     }
-    QUuid requestId = QUuid::createUuid();
 
-    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::HoldingRegisters, registerAddress, 1);
+    ModbusTransaction evicted;
+    if (!connection->queue.enqueue(transaction, &evicted)) {
+        qCWarning(dcModbusCommander()) << "Request queue of" << ipv4Address() << "is full, dropping request for slave" << transaction.slaveAddress;
+        finishRequest(transaction.requestId, false, tr("Request queue full"));
+        return;
+    }
 
-    if (QModbusReply *reply = m_modbusTcpClient->sendReadRequest(request, slaveAddress)) {
-        if (!reply->isFinished()) {
-            connect(reply, &QModbusReply::finished, this, [reply, requestId, this] {
-
-                if (reply->error() == QModbusDevice::NoError) {
-                    requestExecuted(requestId, true);
-                    const QModbusDataUnit unit = reply->result();
-                    uint modbusAddress = unit.startAddress();
-                    emit receivedHoldingRegister(reply->serverAddress(), modbusAddress, unit.value(0));
-
-                } else {
-                    requestExecuted(requestId, false);
-                    qCWarning(dcModbusCommander()) << "Read response error:" << reply->error();
-                }
-                reply->deleteLater();
-            });
-            connect(reply, &QModbusReply::errorOccurred, this, [reply, requestId, this] (QModbusDevice::Error error){
-
-                qCWarning(dcModbusCommander()) << "Modbus replay error:" << error;
-                emit requestError(requestId, reply->errorString());
-                reply->finished(); // To make sure it will be deleted
-            });
-            QTimer::singleShot(200, reply, &QModbusReply::deleteLater);
-        } else {
-            delete reply; // broadcast replies return immediately
-            return "";
-        }
-    } else {
-        qCWarning(dcModbusCommander()) << "Read error: " << m_modbusTcpClient->errorString();
-        return "";
+    if (evicted.requestId != 0) {
+        qCDebug(dcModbusCommander()) << "Request queue of" << ipv4Address() << "is full, dropped queued request for slave" << evicted.slaveAddress;
+        finishRequest(evicted.requestId, false, tr("Request queue full"));
     }
-    return requestId;
+
+    // Send from the event loop, so transactions posted together go out in the order of their priority
+    if (m_inFlightRequests < m_maxInFlight)
+        QTimer::singleShot(0, this, &ModbusTCPMaster::sendNextRequests);
 }
 
-QUuid ModbusTCPMaster::writeCoil(uint slaveAddress, uint registerAddress, bool value)
+void ModbusTCPMaster::sendNextRequests()
 {
-    if (!m_modbusTcpClient) {
-        return "";
+    // The connections share the budget of the gateway, each one gets the first turn in rotation
+    int first = m_nextConnection;
+    m_nextConnection = (m_nextConnection + 1) % m_connections.count();
+    for (int i = 0; i < m_connections.count(); i++) {
+        sendNextRequest((first + i) % m_connections.count());
     }
-    QUuid requestId = QUuid::createUuid();
+}
 
-    QModbusDataUnit request = QModbusDataUnit(QModbusDataUnit::RegisterType::Coils, registerAddress, 1);
-    request.setValue(0, static_cast<uint16_t>(value));
+void ModbusTCPMaster::sendNextRequest(int index)
+{
+    Connection *connection = m_connections.at(index);
 
-    if (QModbusReply *reply = m_modbusTcpClient->sendWriteRequest(request, slaveAddress)) {
-        if (!reply->isFinished()) {
-            connect(reply, &QModbusReply::finished, this, [reply, requestId, this] () {
-
-                if (reply->error() == QModbusDevice::NoError) {
-                    requestExecuted(requestId, true);
-                    const QModbusDataUnit unit = reply->result();
-                    uint modbusAddress = unit.startAddress();
-                    emit receivedCoil(reply->serverAddress(), modbusAddress, unit.value(0));
-
-                } else {
-                    requestExecuted(requestId, false);
-                    qCWarning(dcModbusCommander()) << "Read response error:" << reply->error();
-                }
-                reply->deleteLater();
-            });
-            connect(reply, &QModbusReply::errorOccurred, this, [reply, requestId, this] (QModbusDevice::Error error){
-
-                qCWarning(dcModbusCommander()) << "Modbus reply error:" << error;
-                emit requestError(requestId, reply->errorString());
-                reply->finished(); // To make sure it will be deleted
-            });
-            QTimer::singleShot(200, reply, &QModbusReply::deleteLater);
+    // Keep up to m_maxInFlight transactions outstanding towards the gateway over all connections, the client matches the replies by their transaction id
+    while (m_inFlightRequests < m_maxInFlight && !connection->queue.isEmpty()) {
+        ModbusTransaction transaction = connection->queue.dequeue();
+
+        // The slave went out of service while the request was queued
+        if (!m_circuitBreaker.isAvailable(transaction.slaveAddress) && !m_probeRequests.contains(transaction.requestId)) {
+            finishRequest(transaction.requestId, false, tr("Slave not responding"));
+            continue;
+        }
+
+        // Slaves behind a gateway answer at very different speeds, each one gets its own deadline
+        uint timeout = transaction.timeout > 0 ? transaction.timeout : m_roundTripEstimator.timeout(transaction.slaveAddress);
+        connection->client->setTimeout(static_cast<int>(timeout));
+
+        QModbusReply *reply = nullptr;
+        if (transaction.type == ModbusTransaction::TypeRead) {
+            reply = connection->client->sendReadRequest(transaction.dataUnit, transaction.slaveAddress);
         } else {
-            delete reply; // broadcast replies return immediately
-            return "";
+            reply = connection->client->sendWriteRequest(transaction.dataUnit, transaction.slaveAddress);
         }
-    } else {
-        qCWarning(dcModbusCommander()) << "Read error: " << m_modbusTcpClient->errorString();
-        return "";
+
+        if (!reply) {
+            qCWarning(dcModbusCommander()) << "Send error: " << connection->client->errorString();
+            finishRequest(transaction.requestId, false, connection->client->errorString());
+            continue;
+        }
+
+        connection->requestCount++;
+        if (reply->isFinished()) {
+            // broadcast replies return immediately
+            delete reply;
+            finishRequest(transaction.requestId, true);
+            continue;
+        }
+
+        if (connection->inFlightRequests == 0)
+            connection->busySince = m_clock.elapsed();
+        connection->inFlightRequests++;
+        m_inFlightRequests++;
+        m_peakInFlight = qMax(m_peakInFlight, m_inFlightRequests);
+
+        ModbusRequestId requestId = transaction.requestId;
+        uint slaveAddress = transaction.slaveAddress;
+        bool estimated = (transaction.timeout == 0);
+        qint64 sendTime = m_clock.elapsed();
+        connect(reply, &QModbusReply::finished, this, [reply, requestId, index, slaveAddress, estimated, sendTime, this] {
+            reply->deleteLater();
+
+            Connection *connection = m_connections.at(index);
+            connection->inFlightRequests--;
+            m_inFlightRequests--;
+            if (connection->inFlightRequests == 0)
+                connection->busyTime += m_clock.elapsed() - connection->busySince;
+
+            uint roundTripTime = static_cast<uint>(m_clock.elapsed() - sendTime);
+            // Requests with a deadline of their own, like the probes of a bus scan, say nothing about the slave
+            if (estimated && reply->error() == QModbusDevice::TimeoutError) {
+                m_roundTripEstimator.addTimeout(slaveAddress);
+                m_statistics.addTimeout();
+                if (m_circuitBreaker.addFailure(slaveAddress))
+                    qCWarning(dcModbusCommander()) << "Slave" << slaveAddress << "of" << ipv4Address() << "stopped responding, suspending its requests";
+            } else if (estimated && (reply->error() == QModbusDevice::NoError || reply->error() == QModbusDevice::ProtocolError)) {
+                m_roundTripEstimator.addSample(slaveAddress, roundTripTime);
+                m_statistics.addResponse(roundTripTime);
+                if (reply->error() == QModbusDevice::ProtocolError)
+                    m_statistics.addException(reply->rawResult().exceptionCode());
+                // Exception responses prove the slave is alive as well
+                if (m_circuitBreaker.addResponse(slaveAddress))
+                    qCDebug(dcModbusCommander()) << "Slave" << slaveAddress << "of" << ipv4Address() << "responds again";
+            }
+
+            if (reply->error() == QModbusDevice::NoError) {
+                finishRequest(requestId, true);
+                emitReceivedValues(reply->serverAddress(), reply->result());
+            } else if (!estimated) {
+                // Requests with a deadline of their own, like the short ones of a bus scan, are expected to fail
+                qCDebug(dcModbusCommander()) << "Modbus reply error:" << reply->error() << reply->errorString();
+                finishRequest(requestId, false, reply->errorString(), reply->error() == QModbusDevice::ProtocolError ? reply->rawResult().exceptionCode() : 0);
+            } else {
+                qCWarning(dcModbusCommander()) << "Modbus reply error:" << reply->error() << reply->errorString();
+                finishRequest(requestId, false, reply->errorString(), reply->error() == QModbusDevice::ProtocolError ? reply->rawResult().exceptionCode() : 0);
+            }
+            // The freed slot may go to any connection of the pool
+            sendNextRequests();
+        });
+    }
+}
+
+void ModbusTCPMaster::emitReceivedValues(uint slaveAddress, const QModbusDataUnit &unit)
+{
+    // Block reads deliver all registers of the unit at once, the plugin fans them out
+    switch (unit.registerType()) {
+    case QModbusDataUnit::RegisterType::Coils:
+        emit receivedCoils(slaveAddress, unit.startAddress(), unit.values());
+        break;
+    case QModbusDataUnit::RegisterType::DiscreteInputs:
+        emit receivedDiscreteInputs(slaveAddress, unit.startAddress(), unit.values());
+        break;
+    case QModbusDataUnit::RegisterType::HoldingRegisters:
+        emit receivedHoldingRegisters(slaveAddress, unit.startAddress(), unit.values());
+        break;
+    case QModbusDataUnit::RegisterType::InputRegisters:
+        emit receivedInputRegisters(slaveAddress, unit.startAddress(), unit.values());
+        break;
+    default:
+        qCWarning(dcModbusCommander()) << "Received unhandled register type" << unit.registerType();
+        break;
     }
-    return requestId;
 }
 
 
 void ModbusTCPMaster::onModbusErrorOccurred(QModbusDevice::Error error)
 {
     qCWarning(dcModbusCommander()) << "An error occured" << error;
+    // Malformed or truncated MBAP frames are reported as read errors
+    if (error == QModbusDevice::ReadError)
+        m_statistics.addFrameError();
 }
 
 
 void ModbusTCPMaster::onModbusStateChanged(QModbusDevice::State state)
 {
-    bool connected = (state != QModbusDevice::UnconnectedState);
-    if (!connected) {
-        //try to reconnect in 10 seconds
-        m_reconnectTimer->start(10000);
+    // Connecting and closing are passed through on the way, only the settled states count
+    if (state != QModbusDevice::UnconnectedState && state != QModbusDevice::ConnectedState)
+        return;
+
+    QModbusTcpClient *client = qobject_cast<QModbusTcpClient *>(sender());
+    if (state == QModbusDevice::UnconnectedState) {
+        // Nothing queued on this connection can be sent any more
+        foreach (Connection *connection, m_connections) {
+            if (connection->client != client)
+                continue;
+
+            foreach (const ModbusTransaction &transaction, connection->queue.takeAll()) {
+                finishRequest(transaction.requestId, false, tr("Device disconnected"));
+            }
+        }
+        // Retry quickly after a short blip, back off while the endpoint stays unreachable
+        m_reconnectPolicy.disconnected();
+        if (!m_reconnectTimer->isActive())
+            m_reconnectTimer->start(static_cast<int>(m_reconnectPolicy.nextDelay()));
+    }
+
+    // The endpoint counts as connected as long as one connection of the pool is usable
+    bool connected = false;
+    bool allConnected = true;
+    foreach (Connection *connection, m_connections) {
+        if (connection->client->state() == QModbusDevice::ConnectedState)
+            connected = true;
+        if (connection->client->state() != QModbusDevice::ConnectedState)
+            allConnected = false;
+    }
+    if (allConnected) {
+        m_reconnectPolicy.connected();
+        m_reconnectTimer->stop();
+        // Give every slave a fresh chance on the new connection
+        m_circuitBreaker.clear();
     }
     emit connectionStateChanged(connected);
 }
@@ -27,51 +27,140 @@
 #include <QHostAddress>
 #include <QtSerialBus>
 #include <QTimer>
-#include <QUuid>
+#include <QElapsedTimer>
+#include <QSet>
+#include "modbusrequesttable.h"
+#include "modbustransactionqueue.h"
+#include "roundtripestimator.h"
+#include "modbusstatistics.h"
+#include "modbuswritecoalescer.h"
+#include "reconnectpolicy.h"
+#include "circuitbreaker.h"
+#include "modbusmasterstatus.h"
 
 class ModbusTCPMaster : public QObject
 {
     Q_OBJECT
 public:
-    explicit ModbusTCPMaster(QString ipAddress, uint port, QObject *parent = nullptr);
+    // Requests are spread over the connections of the pool either by slave address or to the least loaded one
+    enum PoolStrategy {
+        PoolStrategySlaveAddress,
+        PoolStrategyLeastLoaded
+    };
+
+    explicit ModbusTCPMaster(QString ipAddress, uint port, int poolSize = 1, QObject *parent = nullptr);
     ~ModbusTCPMaster();
 
-    bool connectDevice();
+    Q_INVOKABLE bool connectDevice();
+    Q_INVOKABLE void reportStatus();
+
+    ModbusRequestId readCoil(uint slaveAddress, uint registerAddress, uint count = 1, ModbusTransaction::Priority priority = ModbusTransaction::PriorityBackground);
+    ModbusRequestId readDiscreteInput(uint slaveAddress, uint registerAddress, uint count = 1, ModbusTransaction::Priority priority = ModbusTransaction::PriorityBackground);
+    ModbusRequestId readInputRegister(uint slaveAddress, uint registerAddress, uint count = 1, ModbusTransaction::Priority priority = ModbusTransaction::PriorityBackground);
+    ModbusRequestId readHoldingRegister(uint slaveAddress, uint registerAddress, uint count = 1, ModbusTransaction::Priority priority = ModbusTransaction::PriorityBackground);
+    ModbusRequestId readRegisters(QModbusDataUnit::RegisterType registerType, uint slaveAddress, uint registerAddress, uint count, ModbusTransaction::Priority priority, uint timeout = 0);
+
+    ModbusRequestId writeCoil(uint slaveAddress, uint registerAddress, bool status);
+    ModbusRequestId writeHoldingRegister(uint slaveAddress, uint registerAddress, uint data);
+    ModbusRequestId writeHoldingRegisters(uint slaveAddress, uint registerAddress, const QVector<quint16> &values);
+
+    uint writeCoalescingWindow() const;
+    void setWriteCoalescingWindow(uint window);
 
-    QUuid readCoil(uint slaveAddress, uint registerAddress);
-    QUuid readDiscreteInput(uint slaveAddress, uint registerAddress);
-    QUuid readInputRegister(uint slaveAddress, uint registerAddress);
-    QUuid readHoldingRegister(uint slaveAddress, uint registerAddress);
+    QString ipv4Address() const;
+    uint port() const;
 
-    QUuid writeCoil(uint slaveAddress, uint registerAddress, bool status);
-    QUuid writeHoldingRegister(uint slaveAddress, uint registerAddress, uint data);
+    int maxInFlight() const;
+    void setMaxInFlight(int maxInFlight);
+    int queueDepth() const;
+    void setQueueDepth(int queueDepth);
+    int pendingRequests() const;
+    int peakInFlight() const;
 
-    QString ipv4Address();
-    uint port();
-    bool setIPv4Address(QString ipAddress);
-    bool setPort(uint port);
+    int poolSize() const;
+    PoolStrategy poolStrategy() const;
+    void setPoolStrategy(PoolStrategy strategy);
+    uint connectionUtilization(int connection) const;
+    uint connectionRequests(int connection) const;
 
+    uint averageQueueWaitTime() const;
+    uint maxQueueWaitTime() const;
+    void resetStatistics();
+
+    uint responseTimeout(uint slaveAddress) const;
+    const ModbusStatistics &statistics() const;
+    uint busUtilization() const;
+    const ReconnectPolicy &reconnectPolicy() const;
+
+    void setCircuitBreaker(uint failureThreshold, uint probeInterval);
+    const CircuitBreaker &circuitBreaker() const;
 
 private:
+    // Fixed at construction, so they can be read from any thread
+    QString m_ipv4Address;
+    uint m_port;
+
+    struct Connection {
+        QModbusTcpClient *client = nullptr;
+        ModbusTransactionQueue queue;
+        int inFlightRequests = 0;
+        uint requestCount = 0;
+        qint64 busySince = 0;
+        qint64 busyTime = 0;
+    };
+
     QTimer *m_reconnectTimer = nullptr;
-    QModbusTcpClient *m_modbusTcpClient;
+    ReconnectPolicy m_reconnectPolicy;
+    QList<Connection *> m_connections;
+    PoolStrategy m_poolStrategy = PoolStrategyLeastLoaded;
+    RoundTripEstimator m_roundTripEstimator;
+    ModbusStatistics m_statistics;
+    CircuitBreaker m_circuitBreaker;
+    QSet<ModbusRequestId> m_probeRequests;
+
+    ModbusWriteCoalescer m_writeCoalescer;
+    QTimer *m_writeCoalescingTimer = nullptr;
+    uint m_writeCoalescingWindow = 0;
+    ModbusRequestTable<QList<ModbusRequestId> > m_coalescedWrites;
+
+    int m_maxInFlight = 4;
+    int m_inFlightRequests = 0;
+    int m_nextConnection = 0;
+    int m_peakInFlight = 0;
+
+    QElapsedTimer m_clock;
+    qint64 m_statisticsSince = 0;
+
+    int selectConnection(uint slaveAddress) const;
+    void sendNextRequest(int connection);
+
+    ModbusRequestId writeRegisters(const QModbusDataUnit &request, uint slaveAddress);
+    ModbusRequestId postTransaction(ModbusTransaction transaction);
+    void enqueueTransaction(ModbusTransaction transaction);
+    void finishRequest(ModbusRequestId requestId, bool success, const QString &error = QString(), int exceptionCode = 0);
+    void emitReceivedValues(uint slaveAddress, const QModbusDataUnit &unit);
 
 private slots:
+    void onTransactionPosted(const ModbusTransaction &transaction);
     void onReconnectTimer();
+    void onWriteCoalescingTimer();
+    void sendNextRequests();
 
     void onModbusErrorOccurred(QModbusDevice::Error error);
     void onModbusStateChanged(QModbusDevice::State state);
 
 signals:
     void connectionStateChanged(bool status);
+    void statusReported(const ModbusMasterStatus &status);
 
-    void requestExecuted(QUuid requestId, bool success);
-    void requestError(QUuid requestId, const QString &error);
+    void requestExecuted(ModbusRequestId requestId, bool success);
+    void requestError(ModbusRequestId requestId, const QString &error);
+    void exceptionResponse(ModbusRequestId requestId, int exceptionCode);
 
-    void receivedCoil(uint slaveAddress, uint modbusRegister, bool value);
-    void receivedDiscreteInput(uint slaveAddress, uint modbusRegister, bool value);
-    void receivedHoldingRegister(uint slaveAddress, uint modbusRegister, uint value);
-    void receivedInputRegister(uint slaveAddress, uint modbusRegister, uint value);
+    void receivedCoils(uint slaveAddress, uint startAddress, const QVector<quint16> &values);
+    void receivedDiscreteInputs(uint slaveAddress, uint startAddress, const QVector<quint16> &values);
+    void receivedHoldingRegisters(uint slaveAddress, uint startAddress, const QVector<quint16> &values);
+    void receivedInputRegisters(uint slaveAddress, uint startAddress, const QVector<quint16> &values);
 };
 
 #endif // MODBUSTCPMASTER_H
@@ -0,0 +1,127 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "modbustransactionqueue.h"
+
+ModbusTransactionQueue::ModbusTransactionQueue(int maxDepth) :
+    m_maxDepth(maxDepth)
+{
+    m_clock.start();
+}
+
+int ModbusTransactionQueue::maxDepth() const
+{
+    return m_maxDepth;
+}
+
+void ModbusTransactionQueue::setMaxDepth(int maxDepth)
+{
+    m_maxDepth = qMax(1, maxDepth);
+}
+
+int ModbusTransactionQueue::count() const
+{
+    return m_count;
+}
+
+bool ModbusTransactionQueue::isEmpty() const
+{
+    return m_count == 0;
+}
+
+bool ModbusTransactionQueue::enqueue(const ModbusTransaction &transaction, ModbusTransaction *evicted)
+{
+    if (m_count >= m_maxDepth) {
+        // Make room by dropping the newest transaction of the lowest class below the new one
+        int priority = PriorityCount - 1;
+        while (priority > transaction.priority && m_queues[priority].isEmpty()) {
+            priority--;
+        }
+        if (priority <= transaction.priority)
+            return false;
+
+        ModbusTransaction dropped = m_queues[priority].takeLast();
+        m_count--;
+        if (evicted)
+            *evicted = dropped;
+    }
+
+    ModbusTransaction queued = transaction;
+    queued.enqueueTime = m_clock.elapsed();
+    m_queues[transaction.priority].enqueue(queued);
+    m_count++;
+    return true;
+}
+
+ModbusTransaction ModbusTransactionQueue::dequeue()
+{
+    for (int priority = 0; priority < PriorityCount; priority++) {
+        if (m_queues[priority].isEmpty())
+            continue;
+
+        ModbusTransaction transaction = m_queues[priority].dequeue();
+        m_count--;
+
+        uint waitTime = static_cast<uint>(m_clock.elapsed() - transaction.enqueueTime);
+        m_waitTimeSum += waitTime;
+        m_waitTimeCount++;
+        m_maxWaitTime = qMax(m_maxWaitTime, waitTime);
+        return transaction;
+    }
+    return ModbusTransaction();
+}
+
+QList<ModbusTransaction> ModbusTransactionQueue::takeAll()
+{
+    QList<ModbusTransaction> transactions;
+    for (int priority = 0; priority < PriorityCount; priority++) {
+        transactions.append(m_queues[priority]);
+        m_queues[priority].clear();
+    }
+    m_count = 0;
+    return transactions;
+}
+
+uint ModbusTransactionQueue::averageWaitTime() const
+{
+    if (m_waitTimeCount == 0)
+        return 0;
+
+    return static_cast<uint>(m_waitTimeSum / m_waitTimeCount);
+}
+
+uint ModbusTransactionQueue::maxWaitTime() const
+{
+    return m_maxWaitTime;
+}
+
+uint ModbusTransactionQueue::waitTimeSamples() const
+{
+    return m_waitTimeCount;
+}
+
+void ModbusTransactionQueue::resetWaitTimeStatistics()
+{
+    m_waitTimeSum = 0;
+    m_waitTimeCount = 0;
+    m_maxWaitTime = 0;
+}
@@ -0,0 +1,93 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MODBUSTRANSACTIONQUEUE_H
+#define MODBUSTRANSACTIONQUEUE_H
+
+#include <QQueue>
+#include <QElapsedTimer>
+#include <QModbusDataUnit>
+#include <QMetaType>
+
+#include "modbusrequesttable.h"
+
+struct ModbusTransaction
+{
+    enum Type {
+        TypeRead,
+        TypeWrite
+    };
+
+    // Lower values are sent first
+    enum Priority {
+        PriorityAction = 0,
+        PriorityTimeCritical,
+        PriorityBackground
+    };
+
+    ModbusRequestId requestId = 0;
+    Type type = TypeRead;
+    Priority priority = PriorityBackground;
+    uint slaveAddress = 0;
+    QModbusDataUnit dataUnit;
+    // Response timeout in ms, 0 takes the estimate of the slave
+    uint timeout = 0;
+    qint64 enqueueTime = 0;
+};
+
+Q_DECLARE_METATYPE(ModbusTransaction)
+
+// Pending bus transactions, ordered by priority class and FIFO within a class
+class ModbusTransactionQueue
+{
+public:
+    explicit ModbusTransactionQueue(int maxDepth = 256);
+
+    int maxDepth() const;
+    void setMaxDepth(int maxDepth);
+
+    int count() const;
+    bool isEmpty() const;
+
+    bool enqueue(const ModbusTransaction &transaction, ModbusTransaction *evicted = nullptr);
+    ModbusTransaction dequeue();
+    QList<ModbusTransaction> takeAll();
+
+    uint averageWaitTime() const;
+    uint maxWaitTime() const;
+    uint waitTimeSamples() const;
+    void resetWaitTimeStatistics();
+
+private:
+    static const int PriorityCount = ModbusTransaction::PriorityBackground + 1;
+
+    QQueue<ModbusTransaction> m_queues[PriorityCount];
+    int m_maxDepth;
+    int m_count = 0;
+
+    QElapsedTimer m_clock;
+    qint64 m_waitTimeSum = 0;
+    uint m_waitTimeCount = 0;
+    uint m_maxWaitTime = 0;
+};
+
+#endif // MODBUSTRANSACTIONQUEUE_H
@@ -0,0 +1,96 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "modbuswritecoalescer.h"
+
+ModbusWriteCoalescer::ModbusWriteCoalescer()
+{
+}
+
+void ModbusWriteCoalescer::addWrite(ModbusRequestId requestId, uint slaveAddress, QModbusDataUnit::RegisterType registerType, uint registerAddress, quint16 value)
+{
+    // Last write wins, the superseded requests are finished with the result of the final value
+    PendingWrite &write = m_writes[key(slaveAddress, registerType, registerAddress)];
+    write.value = value;
+    write.requestIds.append(requestId);
+}
+
+QList<ModbusWriteCoalescer::Write> ModbusWriteCoalescer::takeWrites()
+{
+    QList<Write> writes;
+
+    uint slaveAddress = 0;
+    QModbusDataUnit::RegisterType registerType = QModbusDataUnit::Invalid;
+    uint startAddress = 0;
+    QVector<quint16> values;
+    QList<ModbusRequestId> requestIds;
+
+    QMap<quint64, PendingWrite>::const_iterator it = m_writes.constBegin();
+    while (it != m_writes.constEnd()) {
+        uint writeSlaveAddress = static_cast<uint>(it.key() >> 40);
+        QModbusDataUnit::RegisterType writeRegisterType = static_cast<QModbusDataUnit::RegisterType>((it.key() >> 32) & 0xff);
+        uint writeAddress = static_cast<uint>(it.key() & 0xffffffff);
+
+        // Limits of a single FC15 and FC16 request frame
+        int maxCount = (writeRegisterType == QModbusDataUnit::Coils) ? 1968 : 123;
+        bool adjacent = !values.isEmpty()
+                && writeSlaveAddress == slaveAddress
+                && writeRegisterType == registerType
+                && writeAddress == startAddress + static_cast<uint>(values.count())
+                && values.count() < maxCount;
+
+        if (!adjacent && !values.isEmpty()) {
+            Write write;
+            write.slaveAddress = slaveAddress;
+            write.dataUnit = QModbusDataUnit(registerType, static_cast<int>(startAddress), values);
+            write.requestIds = requestIds;
+            writes.append(write);
+            values.clear();
+            requestIds.clear();
+        }
+
+        if (values.isEmpty()) {
+            slaveAddress = writeSlaveAddress;
+            registerType = writeRegisterType;
+            startAddress = writeAddress;
+        }
+        values.append(it.value().value);
+        requestIds.append(it.value().requestIds);
+        ++it;
+    }
+
+    if (!values.isEmpty()) {
+        Write write;
+        write.slaveAddress = slaveAddress;
+        write.dataUnit = QModbusDataUnit(registerType, static_cast<int>(startAddress), values);
+        write.requestIds = requestIds;
+        writes.append(write);
+    }
+
+    m_writes.clear();
+    return writes;
+}
+
+quint64 ModbusWriteCoalescer::key(uint slaveAddress, QModbusDataUnit::RegisterType registerType, uint registerAddress)
+{
+    return (static_cast<quint64>(slaveAddress) << 40) | (static_cast<quint64>(registerType & 0xff) << 32) | registerAddress;
+}
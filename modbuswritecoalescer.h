@@ -0,0 +1,61 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MODBUSWRITECOALESCER_H
+#define MODBUSWRITECOALESCER_H
+
+#include <QMap>
+#include <QList>
+#include <QModbusDataUnit>
+
+#include "modbusrequesttable.h"
+
+// Collects single coil and register writes for a short window. Writes to the same address
+// collapse to the latest value, adjacent addresses of one slave go out as one multi write.
+class ModbusWriteCoalescer
+{
+public:
+    struct Write {
+        uint slaveAddress = 0;
+        QModbusDataUnit dataUnit;
+        QList<ModbusRequestId> requestIds;
+    };
+
+    ModbusWriteCoalescer();
+
+    void addWrite(ModbusRequestId requestId, uint slaveAddress, QModbusDataUnit::RegisterType registerType, uint registerAddress, quint16 value);
+
+    QList<Write> takeWrites();
+
+private:
+    struct PendingWrite {
+        quint16 value = 0;
+        QList<ModbusRequestId> requestIds;
+    };
+
+    // Ordered by slave, register type and address, so adjacent writes follow each other
+    QMap<quint64, PendingWrite> m_writes;
+
+    static quint64 key(uint slaveAddress, QModbusDataUnit::RegisterType registerType, uint registerAddress);
+};
+
+#endif // MODBUSWRITECOALESCER_H
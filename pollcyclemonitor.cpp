@@ -0,0 +1,183 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "pollcyclemonitor.h"
+
+PollCycleMonitor::PollCycleMonitor()
+{
+    m_clock.start();
+}
+
+void PollCycleMonitor::setMaxOutstandingPolls(QObject *master, int maxOutstandingPolls)
+{
+    m_masters[master].maxOutstandingPolls = qMax(1, maxOutstandingPolls);
+}
+
+void PollCycleMonitor::removeMaster(QObject *master)
+{
+    m_masters.remove(master);
+
+    QHash<PollPointKey, bool>::iterator it = m_outstandingPolls.begin();
+    while (it != m_outstandingPolls.end()) {
+        if (it.key().master == master) {
+            it = m_outstandingPolls.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    QHash<PollPointKey, qint64>::iterator completion = m_lastCompletion.begin();
+    while (completion != m_lastCompletion.end()) {
+        if (completion.key().master == master) {
+            completion = m_lastCompletion.erase(completion);
+        } else {
+            ++completion;
+        }
+    }
+
+    QHash<PollPointKey, qint64>::iterator fresh = m_freshUntil.begin();
+    while (fresh != m_freshUntil.end()) {
+        if (fresh.key().master == master) {
+            fresh = m_freshUntil.erase(fresh);
+        } else {
+            ++fresh;
+        }
+    }
+}
+
+void PollCycleMonitor::clearCycleTimes()
+{
+    // Block boundaries changed, the previous completions do not belong to the new blocks
+    m_lastCompletion.clear();
+}
+
+bool PollCycleMonitor::beginPoll(const PollBlock &block)
+{
+    PollPointKey key = blockKey(block);
+    MasterStatistics &statistics = m_masters[block.master];
+
+    if (m_outstandingPolls.contains(key) || statistics.outstandingPolls >= statistics.maxOutstandingPolls) {
+        statistics.overruns++;
+        return false;
+    }
+
+    m_outstandingPolls.insert(key, true);
+    statistics.outstandingPolls++;
+    return true;
+}
+
+void PollCycleMonitor::cancelPoll(const PollPointKey &block)
+{
+    if (m_outstandingPolls.remove(block) == 0)
+        return;
+
+    QHash<QObject *, MasterStatistics>::iterator statistics = m_masters.find(block.master);
+    if (statistics != m_masters.end())
+        statistics->outstandingPolls--;
+}
+
+void PollCycleMonitor::finishPoll(const PollPointKey &block)
+{
+    if (m_outstandingPolls.remove(block) == 0)
+        return;
+
+    QHash<QObject *, MasterStatistics>::iterator statistics = m_masters.find(block.master);
+    if (statistics == m_masters.end())
+        return;
+
+    statistics->outstandingPolls--;
+
+    // The effective cycle time is the time between two completed polls of the same block
+    qint64 now = m_clock.elapsed();
+    if (m_lastCompletion.contains(block)) {
+        statistics->cycleTimeSum += now - m_lastCompletion.value(block);
+        statistics->cycleTimeCount++;
+    }
+    m_lastCompletion.insert(block, now);
+}
+
+void PollCycleMonitor::setFresh(const PollPointKey &point, uint lifetime)
+{
+    qint64 freshUntil = m_clock.elapsed() + lifetime;
+    if (m_freshUntil.value(point, 0) < freshUntil)
+        m_freshUntil.insert(point, freshUntil);
+}
+
+void PollCycleMonitor::removePoint(const PollPointKey &point)
+{
+    // A point set up at the same address later must not inherit the window
+    m_freshUntil.remove(point);
+}
+
+bool PollCycleMonitor::skipFreshPoll(QObject *master, const QList<PollPointKey> &points)
+{
+    if (points.isEmpty())
+        return false;
+
+    qint64 now = m_clock.elapsed();
+    foreach (const PollPointKey &point, points) {
+        if (m_freshUntil.value(point, 0) <= now)
+            return false;
+    }
+
+    m_masters[master].freshSkips++;
+    return true;
+}
+
+int PollCycleMonitor::outstandingPolls(QObject *master) const
+{
+    return m_masters.value(master).outstandingPolls;
+}
+
+uint PollCycleMonitor::overruns(QObject *master) const
+{
+    return m_masters.value(master).overruns;
+}
+
+uint PollCycleMonitor::freshSkips(QObject *master) const
+{
+    return m_masters.value(master).freshSkips;
+}
+
+uint PollCycleMonitor::averageCycleTime(QObject *master) const
+{
+    MasterStatistics statistics = m_masters.value(master);
+    if (statistics.cycleTimeCount == 0)
+        return 0;
+
+    return static_cast<uint>(statistics.cycleTimeSum / statistics.cycleTimeCount);
+}
+
+void PollCycleMonitor::resetCycleTimeStatistics(QObject *master)
+{
+    QHash<QObject *, MasterStatistics>::iterator statistics = m_masters.find(master);
+    if (statistics == m_masters.end())
+        return;
+
+    statistics->cycleTimeSum = 0;
+    statistics->cycleTimeCount = 0;
+}
+
+PollPointKey PollCycleMonitor::blockKey(const PollBlock &block)
+{
+    return PollPointKey(block.master, block.slaveAddress, block.registerType, block.startAddress);
+}
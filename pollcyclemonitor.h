@@ -0,0 +1,78 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef POLLCYCLEMONITOR_H
+#define POLLCYCLEMONITOR_H
+
+#include <QHash>
+#include <QElapsedTimer>
+
+#include "pollplanner.h"
+
+// Keeps track of outstanding block polls per master. A block that is due again while its previous
+// poll is still outstanding, or a master that already has too many polls outstanding, is skipped
+// and counted as overrun, which stretches the effective cycle instead of piling up requests.
+// Points confirmed by a recent read or write are fresh for a while, a block made up of fresh
+// points only is skipped as well.
+class PollCycleMonitor
+{
+public:
+    PollCycleMonitor();
+
+    void setMaxOutstandingPolls(QObject *master, int maxOutstandingPolls);
+    void removeMaster(QObject *master);
+    void clearCycleTimes();
+
+    bool beginPoll(const PollBlock &block);
+    void cancelPoll(const PollPointKey &block);
+    void finishPoll(const PollPointKey &block);
+
+    void setFresh(const PollPointKey &point, uint lifetime);
+    void removePoint(const PollPointKey &point);
+    bool skipFreshPoll(QObject *master, const QList<PollPointKey> &points);
+
+    int outstandingPolls(QObject *master) const;
+    uint overruns(QObject *master) const;
+    uint freshSkips(QObject *master) const;
+    uint averageCycleTime(QObject *master) const;
+    void resetCycleTimeStatistics(QObject *master);
+
+    static PollPointKey blockKey(const PollBlock &block);
+
+private:
+    struct MasterStatistics {
+        int maxOutstandingPolls = 32;
+        int outstandingPolls = 0;
+        uint overruns = 0;
+        uint freshSkips = 0;
+        qint64 cycleTimeSum = 0;
+        uint cycleTimeCount = 0;
+    };
+
+    QElapsedTimer m_clock;
+    QHash<QObject *, MasterStatistics> m_masters;
+    QHash<PollPointKey, bool> m_outstandingPolls;
+    QHash<PollPointKey, qint64> m_lastCompletion;
+    QHash<PollPointKey, qint64> m_freshUntil;
+};
+
+#endif // POLLCYCLEMONITOR_H
@@ -0,0 +1,169 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "pollplanner.h"
+
+#include <QVector>
+#include <algorithm>
+
+PollPlanner::PollPlanner()
+{
+}
+
+void PollPlanner::setBlockLimits(QObject *master, uint maxGap, uint maxSpan)
+{
+    BlockLimits limits;
+    limits.maxGap = maxGap;
+    limits.maxSpan = maxSpan;
+    m_blockLimits.insert(master, limits);
+    m_dirty = true;
+}
+
+void PollPlanner::setDefaultInterval(uint interval)
+{
+    if (m_defaultInterval == interval)
+        return;
+
+    m_defaultInterval = interval;
+    m_dirty = true;
+}
+
+void PollPlanner::addPoint(Device *device, QObject *master, uint slaveAddress, QModbusDataUnit::RegisterType registerType, uint registerAddress, uint pollInterval, uint count)
+{
+    PollPoint point;
+    point.device = device;
+    point.master = master;
+    point.slaveAddress = slaveAddress;
+    point.registerType = registerType;
+    point.registerAddress = registerAddress;
+    point.count = qMax(1u, count);
+    point.pollInterval = pollInterval;
+    m_points.insert(device, point);
+    m_dirty = true;
+}
+
+void PollPlanner::removePoint(Device *device)
+{
+    if (m_points.remove(device) > 0)
+        m_dirty = true;
+}
+
+void PollPlanner::removeMaster(QObject *master)
+{
+    QHash<Device *, PollPoint>::iterator it = m_points.begin();
+    while (it != m_points.end()) {
+        if (it.value().master == master) {
+            it = m_points.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_blockLimits.remove(master);
+    m_dirty = true;
+}
+
+bool PollPlanner::isEmpty() const
+{
+    return m_points.isEmpty();
+}
+
+QList<PollBlock> PollPlanner::blocks()
+{
+    if (m_dirty) {
+        rebuild();
+        m_dirty = false;
+    }
+    return m_blocks;
+}
+
+uint PollPlanner::maxRequestSpan(QModbusDataUnit::RegisterType registerType)
+{
+    // Limits of a single FC01/FC02 (bits) and FC03/FC04 (registers) response frame
+    if (registerType == QModbusDataUnit::Coils || registerType == QModbusDataUnit::DiscreteInputs)
+        return 2000;
+
+    return 125;
+}
+
+void PollPlanner::rebuild()
+{
+    m_blocks.clear();
+
+    QVector<PollPoint> points;
+    points.reserve(m_points.count());
+    foreach (PollPoint point, m_points) {
+        // An interval equal to the default polls with the points using the default, they share blocks
+        if (point.pollInterval == m_defaultInterval)
+            point.pollInterval = 0;
+        points.append(point);
+    }
+
+    std::sort(points.begin(), points.end(), [](const PollPoint &a, const PollPoint &b) {
+        if (a.master != b.master)
+            return a.master < b.master;
+        if (a.slaveAddress != b.slaveAddress)
+            return a.slaveAddress < b.slaveAddress;
+        if (a.registerType != b.registerType)
+            return a.registerType < b.registerType;
+        if (a.pollInterval != b.pollInterval)
+            return a.pollInterval < b.pollInterval;
+        return a.registerAddress < b.registerAddress;
+    });
+
+    PollBlock block;
+    foreach (const PollPoint &point, points) {
+        BlockLimits limits = m_blockLimits.value(point.master, BlockLimits{0, maxRequestSpan(point.registerType)});
+        uint maxSpan = qBound(1u, limits.maxSpan, maxRequestSpan(point.registerType));
+
+        bool sameGroup = !block.devices.isEmpty()
+                && block.master == point.master
+                && block.slaveAddress == point.slaveAddress
+                && block.registerType == point.registerType
+                && block.pollInterval == point.pollInterval;
+
+        if (sameGroup) {
+            uint blockEnd = block.startAddress + block.count;
+            uint gap = point.registerAddress >= blockEnd ? point.registerAddress - blockEnd : 0;
+            uint span = qMax(blockEnd, point.registerAddress + point.count) - block.startAddress;
+            if (gap <= limits.maxGap && span <= maxSpan) {
+                block.count = span;
+                block.devices.append(point.device);
+                continue;
+            }
+        }
+
+        if (!block.devices.isEmpty())
+            m_blocks.append(block);
+
+        block = PollBlock();
+        block.master = point.master;
+        block.slaveAddress = point.slaveAddress;
+        block.registerType = point.registerType;
+        block.startAddress = point.registerAddress;
+        block.count = point.count;
+        block.pollInterval = point.pollInterval;
+        block.devices.append(point.device);
+    }
+
+    if (!block.devices.isEmpty())
+        m_blocks.append(block);
+}
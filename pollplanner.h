@@ -0,0 +1,113 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef POLLPLANNER_H
+#define POLLPLANNER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QModbusDataUnit>
+
+class Device;
+
+// Identifies one register of one slave behind a master, used to dispatch replies to their devices
+struct PollPointKey
+{
+    PollPointKey(QObject *master = nullptr, uint slaveAddress = 0, QModbusDataUnit::RegisterType registerType = QModbusDataUnit::Invalid, uint registerAddress = 0) :
+        master(master), slaveAddress(slaveAddress), registerType(registerType), registerAddress(registerAddress) { }
+
+    QObject *master;
+    uint slaveAddress;
+    QModbusDataUnit::RegisterType registerType;
+    uint registerAddress;
+
+    bool operator==(const PollPointKey &other) const {
+        return master == other.master
+                && slaveAddress == other.slaveAddress
+                && registerType == other.registerType
+                && registerAddress == other.registerAddress;
+    }
+};
+
+inline uint qHash(const PollPointKey &key, uint seed = 0)
+{
+    // Slave addresses fit into 8 bit, register types into 8 bit and register addresses into 16 bit
+    return qHash(key.master, seed) ^ qHash((key.slaveAddress << 24) ^ (static_cast<uint>(key.registerType) << 16) ^ key.registerAddress, seed);
+}
+
+// One read request covering one or more child devices of the same master, slave and register type
+struct PollBlock
+{
+    QObject *master = nullptr;
+    uint slaveAddress = 0;
+    QModbusDataUnit::RegisterType registerType = QModbusDataUnit::Invalid;
+    uint startAddress = 0;
+    uint count = 0;
+    uint pollInterval = 0;
+    QList<Device *> devices;
+};
+
+class PollPlanner
+{
+public:
+    PollPlanner();
+
+    void setBlockLimits(QObject *master, uint maxGap, uint maxSpan);
+    void setDefaultInterval(uint interval);
+
+    void addPoint(Device *device, QObject *master, uint slaveAddress, QModbusDataUnit::RegisterType registerType, uint registerAddress, uint pollInterval = 0, uint count = 1);
+    void removePoint(Device *device);
+    void removeMaster(QObject *master);
+
+    bool isEmpty() const;
+    QList<PollBlock> blocks();
+
+    static uint maxRequestSpan(QModbusDataUnit::RegisterType registerType);
+
+private:
+    struct PollPoint {
+        Device *device;
+        QObject *master;
+        uint slaveAddress;
+        QModbusDataUnit::RegisterType registerType;
+        uint registerAddress;
+        uint count;
+        uint pollInterval;
+    };
+
+    struct BlockLimits {
+        uint maxGap;
+        uint maxSpan;
+    };
+
+    QHash<Device *, PollPoint> m_points;
+    QHash<QObject *, BlockLimits> m_blockLimits;
+    uint m_defaultInterval = 1000;
+
+    bool m_dirty = true;
+    QList<PollBlock> m_blocks;
+
+    void rebuild();
+};
+
+#endif // POLLPLANNER_H
@@ -0,0 +1,120 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "pollscheduler.h"
+
+#include <QHash>
+#include <QPair>
+
+PollScheduler::PollScheduler(QObject *parent) :
+    QObject(parent)
+{
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    connect(m_timer, &QTimer::timeout, this, &PollScheduler::onTimeout);
+    m_clock.start();
+}
+
+uint PollScheduler::defaultInterval() const
+{
+    return m_defaultInterval;
+}
+
+void PollScheduler::setDefaultInterval(uint interval)
+{
+    m_defaultInterval = qMax(1u, interval);
+}
+
+void PollScheduler::setBlocks(const QList<PollBlock> &blocks)
+{
+    m_generation++;
+    m_blocks = blocks;
+    m_dueBlocks.clear();
+
+    // Spread the blocks of each master and interval evenly over one period
+    QHash<QPair<QObject *, uint>, QList<int> > groups;
+    for (int i = 0; i < m_blocks.count(); i++) {
+        groups[qMakePair(m_blocks.at(i).master, interval(m_blocks.at(i)))].append(i);
+    }
+
+    qint64 now = m_clock.elapsed();
+    foreach (const QList<int> &group, groups) {
+        uint period = interval(m_blocks.at(group.first()));
+        for (int i = 0; i < group.count(); i++) {
+            qint64 phase = static_cast<qint64>(period) * i / group.count();
+            m_dueBlocks.insert(now + phase, group.at(i));
+        }
+    }
+
+    scheduleNextTimeout();
+}
+
+void PollScheduler::clear()
+{
+    setBlocks(QList<PollBlock>());
+}
+
+uint PollScheduler::interval(const PollBlock &block) const
+{
+    if (block.pollInterval == 0)
+        return m_defaultInterval;
+
+    return block.pollInterval;
+}
+
+void PollScheduler::scheduleNextTimeout()
+{
+    if (m_dueBlocks.isEmpty()) {
+        m_timer->stop();
+        return;
+    }
+
+    qint64 delay = m_dueBlocks.firstKey() - m_clock.elapsed();
+    m_timer->start(static_cast<int>(qMax<qint64>(0, delay)));
+}
+
+void PollScheduler::onTimeout()
+{
+    uint generation = m_generation;
+    qint64 now = m_clock.elapsed();
+
+    while (!m_dueBlocks.isEmpty() && m_dueBlocks.firstKey() <= now) {
+        qint64 due = m_dueBlocks.firstKey();
+        int index = m_dueBlocks.take(due);
+
+        PollBlock block = m_blocks.at(index);
+        qint64 nextDue = due + interval(block);
+        if (nextDue <= now) {
+            // We fell behind, don't try to catch up with a burst of requests
+            nextDue = now + interval(block);
+        }
+        m_dueBlocks.insert(nextDue, index);
+
+        emit pollDue(block);
+
+        // The blocks have been replaced while handling the poll
+        if (generation != m_generation)
+            return;
+    }
+
+    scheduleNextTimeout();
+}
@@ -0,0 +1,67 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef POLLSCHEDULER_H
+#define POLLSCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QMultiMap>
+
+#include "pollplanner.h"
+
+// Runs every poll block at its own interval. Blocks of the same master sharing an interval
+// get evenly spread phases, so the bus sees a steady stream of requests instead of bursts.
+class PollScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PollScheduler(QObject *parent = nullptr);
+
+    uint defaultInterval() const;
+    void setDefaultInterval(uint interval);
+
+    void setBlocks(const QList<PollBlock> &blocks);
+    void clear();
+
+    uint interval(const PollBlock &block) const;
+
+private:
+    QTimer *m_timer = nullptr;
+    QElapsedTimer m_clock;
+
+    uint m_defaultInterval = 1000;
+    uint m_generation = 0;
+    QList<PollBlock> m_blocks;
+    QMultiMap<qint64, int> m_dueBlocks;
+
+    void scheduleNextTimeout();
+
+private slots:
+    void onTimeout();
+
+signals:
+    void pollDue(const PollBlock &block);
+};
+
+#endif // POLLSCHEDULER_H
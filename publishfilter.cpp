@@ -0,0 +1,73 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "publishfilter.h"
+
+#include <QtMath>
+
+PublishFilter::PublishFilter()
+{
+    m_clock.start();
+}
+
+void PublishFilter::setLimits(Device *device, double deadband, double deadbandPercent, uint minPublishInterval)
+{
+    // A reconfigured device starts over with its next reading
+    Filter filter;
+    filter.deadband = qMax(0.0, deadband);
+    filter.deadbandPercent = qMax(0.0, deadbandPercent);
+    filter.minPublishInterval = minPublishInterval;
+    m_filters.insert(device, filter);
+}
+
+void PublishFilter::removeDevice(Device *device)
+{
+    m_filters.remove(device);
+}
+
+bool PublishFilter::accept(Device *device, double value)
+{
+    Filter &filter = m_filters[device];
+    qint64 now = m_clock.elapsed();
+
+    if (filter.published) {
+        double change = qAbs(value - filter.lastValue);
+        bool withinDeadband = (change == 0)
+                || (change <= filter.deadband)
+                || (change <= qAbs(filter.lastValue) * filter.deadbandPercent / 100);
+        bool tooEarly = (now - filter.lastPublishTime) < filter.minPublishInterval;
+        if (withinDeadband || tooEarly) {
+            filter.suppressedUpdates++;
+            return false;
+        }
+    }
+
+    filter.published = true;
+    filter.lastValue = value;
+    filter.lastPublishTime = now;
+    return true;
+}
+
+uint PublishFilter::suppressedUpdates(Device *device) const
+{
+    return m_filters.value(device).suppressedUpdates;
+}
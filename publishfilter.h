@@ -0,0 +1,60 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef PUBLISHFILTER_H
+#define PUBLISHFILTER_H
+
+#include <QHash>
+#include <QElapsedTimer>
+
+class Device;
+
+// Decides which readings of a register device are worth a state change. Readings equal to
+// the last published value, within its deadband or arriving before the minimum publish
+// interval elapsed are dropped and counted.
+class PublishFilter
+{
+public:
+    PublishFilter();
+
+    void setLimits(Device *device, double deadband, double deadbandPercent, uint minPublishInterval);
+    void removeDevice(Device *device);
+
+    bool accept(Device *device, double value);
+    uint suppressedUpdates(Device *device) const;
+
+private:
+    struct Filter {
+        double deadband = 0;
+        double deadbandPercent = 0;
+        uint minPublishInterval = 0;
+        bool published = false;
+        double lastValue = 0;
+        qint64 lastPublishTime = 0;
+        uint suppressedUpdates = 0;
+    };
+
+    QElapsedTimer m_clock;
+    QHash<Device *, Filter> m_filters;
+};
+
+#endif // PUBLISHFILTER_H
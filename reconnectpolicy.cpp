@@ -0,0 +1,82 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "reconnectpolicy.h"
+
+#include <QtGlobal>
+
+ReconnectPolicy::ReconnectPolicy(uint initialDelay, uint maxDelay) :
+    m_initialDelay(qMax(1u, initialDelay)),
+    m_maxDelay(qMax(initialDelay, maxDelay)),
+    m_random(std::random_device()())
+{
+}
+
+void ReconnectPolicy::setLimits(uint initialDelay, uint maxDelay)
+{
+    m_initialDelay = qMax(1u, initialDelay);
+    m_maxDelay = qMax(m_initialDelay, maxDelay);
+}
+
+uint ReconnectPolicy::nextDelay()
+{
+    // Equal jitter, the delay lies between half and the full backoff
+    m_backoff = (m_backoff == 0) ? m_initialDelay : qMin(m_maxDelay, m_backoff * 2);
+    std::uniform_int_distribution<uint> distribution(m_backoff / 2, m_backoff);
+    m_currentBackoff = distribution(m_random);
+    m_reconnectAttempts++;
+    return m_currentBackoff;
+}
+
+void ReconnectPolicy::disconnected()
+{
+    if (m_disconnected)
+        return;
+
+    m_disconnected = true;
+    m_disconnectedSince.start();
+}
+
+void ReconnectPolicy::connected()
+{
+    if (m_disconnected)
+        m_lastReconnectTime = static_cast<uint>(m_disconnectedSince.elapsed());
+
+    m_disconnected = false;
+    m_backoff = 0;
+    m_currentBackoff = 0;
+}
+
+uint ReconnectPolicy::reconnectAttempts() const
+{
+    return m_reconnectAttempts;
+}
+
+uint ReconnectPolicy::currentBackoff() const
+{
+    return m_currentBackoff;
+}
+
+uint ReconnectPolicy::lastReconnectTime() const
+{
+    return m_lastReconnectTime;
+}
@@ -0,0 +1,61 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef RECONNECTPOLICY_H
+#define RECONNECTPOLICY_H
+
+#include <QElapsedTimer>
+#include <random>
+
+// Delays between reconnect attempts. The first retry follows quickly, every further one doubles
+// the delay up to a cap. The delays are jittered so gateways losing their link at the same time
+// don't reconnect in lockstep.
+class ReconnectPolicy
+{
+public:
+    explicit ReconnectPolicy(uint initialDelay = 500, uint maxDelay = 60000);
+
+    void setLimits(uint initialDelay, uint maxDelay);
+
+    uint nextDelay();
+    void disconnected();
+    void connected();
+
+    uint reconnectAttempts() const;
+    uint currentBackoff() const;
+    uint lastReconnectTime() const;
+
+private:
+    uint m_initialDelay;
+    uint m_maxDelay;
+
+    uint m_backoff = 0;
+    uint m_currentBackoff = 0;
+    uint m_reconnectAttempts = 0;
+    uint m_lastReconnectTime = 0;
+
+    bool m_disconnected = false;
+    QElapsedTimer m_disconnectedSince;
+    std::mt19937 m_random;
+};
+
+#endif // RECONNECTPOLICY_H
@@ -0,0 +1,176 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "registerdecoder.h"
+
+#include <limits>
+
+namespace {
+
+template <typename T>
+int decodeAs(RegisterDecoder::ByteOrder byteOrder, const quint16 *registers, int registerCount, double *values)
+{
+    // One switch per block, the loops below are specialized for the byte order
+    switch (byteOrder) {
+    case RegisterDecoder::ByteOrderCDAB:
+        return RegisterDecoder::decodeBlock<T, RegisterDecoder::ByteOrderCDAB>(registers, registerCount, values);
+    case RegisterDecoder::ByteOrderBADC:
+        return RegisterDecoder::decodeBlock<T, RegisterDecoder::ByteOrderBADC>(registers, registerCount, values);
+    case RegisterDecoder::ByteOrderDCBA:
+        return RegisterDecoder::decodeBlock<T, RegisterDecoder::ByteOrderDCBA>(registers, registerCount, values);
+    default:
+        return RegisterDecoder::decodeBlock<T, RegisterDecoder::ByteOrderABCD>(registers, registerCount, values);
+    }
+}
+
+template <typename T>
+void encodeAs(RegisterDecoder::ByteOrder byteOrder, T value, quint16 *registers)
+{
+    switch (byteOrder) {
+    case RegisterDecoder::ByteOrderCDAB:
+        RegisterDecoder::encodeValue<T, RegisterDecoder::ByteOrderCDAB>(value, registers);
+        break;
+    case RegisterDecoder::ByteOrderBADC:
+        RegisterDecoder::encodeValue<T, RegisterDecoder::ByteOrderBADC>(value, registers);
+        break;
+    case RegisterDecoder::ByteOrderDCBA:
+        RegisterDecoder::encodeValue<T, RegisterDecoder::ByteOrderDCBA>(value, registers);
+        break;
+    default:
+        RegisterDecoder::encodeValue<T, RegisterDecoder::ByteOrderABCD>(value, registers);
+        break;
+    }
+}
+
+template <typename T>
+T toInteger(double value)
+{
+    // Out of range values saturate instead of wrapping around
+    if (value <= static_cast<double>(std::numeric_limits<T>::min()))
+        return std::numeric_limits<T>::min();
+    if (value >= static_cast<double>(std::numeric_limits<T>::max()))
+        return std::numeric_limits<T>::max();
+
+    return static_cast<T>(qRound64(value));
+}
+
+}
+
+RegisterDecoder::DataType RegisterDecoder::dataType(const QString &name)
+{
+    if (name == "Int16") {
+        return DataTypeInt16;
+    } else if (name == "UInt32") {
+        return DataTypeUInt32;
+    } else if (name == "Int32") {
+        return DataTypeInt32;
+    } else if (name == "Float32") {
+        return DataTypeFloat32;
+    } else if (name == "Float64") {
+        return DataTypeFloat64;
+    }
+    return DataTypeUInt16;
+}
+
+RegisterDecoder::ByteOrder RegisterDecoder::byteOrder(const QString &name)
+{
+    if (name.startsWith("CDAB")) {
+        return ByteOrderCDAB;
+    } else if (name.startsWith("BADC")) {
+        return ByteOrderBADC;
+    } else if (name.startsWith("DCBA")) {
+        return ByteOrderDCBA;
+    }
+    return ByteOrderABCD;
+}
+
+int RegisterDecoder::registerCount(RegisterDecoder::DataType dataType)
+{
+    switch (dataType) {
+    case DataTypeUInt32:
+    case DataTypeInt32:
+    case DataTypeFloat32:
+        return 2;
+    case DataTypeFloat64:
+        return 4;
+    default:
+        return 1;
+    }
+}
+
+double RegisterDecoder::decodeValue(RegisterDecoder::DataType dataType, RegisterDecoder::ByteOrder byteOrder, const quint16 *registers)
+{
+    double value = 0;
+    decode(dataType, byteOrder, registers, registerCount(dataType), &value);
+    return value;
+}
+
+int RegisterDecoder::decode(RegisterDecoder::DataType dataType, RegisterDecoder::ByteOrder byteOrder, const quint16 *registers, int registerCount, double *values)
+{
+    switch (dataType) {
+    case DataTypeInt16:
+        return decodeAs<qint16>(byteOrder, registers, registerCount, values);
+    case DataTypeUInt32:
+        return decodeAs<quint32>(byteOrder, registers, registerCount, values);
+    case DataTypeInt32:
+        return decodeAs<qint32>(byteOrder, registers, registerCount, values);
+    case DataTypeFloat32:
+        return decodeAs<float>(byteOrder, registers, registerCount, values);
+    case DataTypeFloat64:
+        return decodeAs<double>(byteOrder, registers, registerCount, values);
+    default:
+        return decodeAs<quint16>(byteOrder, registers, registerCount, values);
+    }
+}
+
+QVector<double> RegisterDecoder::decode(RegisterDecoder::DataType dataType, RegisterDecoder::ByteOrder byteOrder, const QVector<quint16> &registers)
+{
+    QVector<double> values(registers.count() / registerCount(dataType));
+    decode(dataType, byteOrder, registers.constData(), registers.count(), values.data());
+    return values;
+}
+
+QVector<quint16> RegisterDecoder::encode(RegisterDecoder::DataType dataType, RegisterDecoder::ByteOrder byteOrder, double value)
+{
+    QVector<quint16> registers(registerCount(dataType));
+    switch (dataType) {
+    case DataTypeInt16:
+        encodeAs<qint16>(byteOrder, toInteger<qint16>(value), registers.data());
+        break;
+    case DataTypeUInt32:
+        encodeAs<quint32>(byteOrder, toInteger<quint32>(value), registers.data());
+        break;
+    case DataTypeInt32:
+        encodeAs<qint32>(byteOrder, toInteger<qint32>(value), registers.data());
+        break;
+    case DataTypeFloat32:
+        encodeAs<float>(byteOrder, static_cast<float>(value), registers.data());
+        break;
+    case DataTypeFloat64:
+        encodeAs<double>(byteOrder, value, registers.data());
+        break;
+    default:
+        encodeAs<quint16>(byteOrder, toInteger<quint16>(value), registers.data());
+        break;
+    }
+    return registers;
+}
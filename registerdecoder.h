@@ -0,0 +1,128 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef REGISTERDECODER_H
+#define REGISTERDECODER_H
+
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+#include <cstring>
+
+// Converts between 16 bit Modbus registers and typed values spread over one to four registers.
+// The conversion for every combination of type and byte order is generated at compile time,
+// the per value loop is free of branches so the compiler can vectorize decoding of large blocks.
+class RegisterDecoder
+{
+public:
+    enum DataType {
+        DataTypeUInt16,
+        DataTypeInt16,
+        DataTypeUInt32,
+        DataTypeInt32,
+        DataTypeFloat32,
+        DataTypeFloat64
+    };
+
+    // Named after the order of the bytes A (most significant) to D on the wire
+    enum ByteOrder {
+        ByteOrderABCD,
+        ByteOrderCDAB,
+        ByteOrderBADC,
+        ByteOrderDCBA
+    };
+
+    static DataType dataType(const QString &name);
+    static ByteOrder byteOrder(const QString &name);
+    static int registerCount(DataType dataType);
+
+    static double decodeValue(DataType dataType, ByteOrder byteOrder, const quint16 *registers);
+    static int decode(DataType dataType, ByteOrder byteOrder, const quint16 *registers, int registerCount, double *values);
+    static QVector<double> decode(DataType dataType, ByteOrder byteOrder, const QVector<quint16> &registers);
+    static QVector<quint16> encode(DataType dataType, ByteOrder byteOrder, double value);
+
+    template <typename T, ByteOrder Order>
+    static T decodeValue(const quint16 *registers)
+    {
+        typedef typename Raw<sizeof(T)>::Type RawType;
+        const int words = sizeof(T) / 2;
+
+        RawType raw = 0;
+        for (int i = 0; i < words; i++) {
+            quint16 word = registers[swapWords(Order) ? words - 1 - i : i];
+            if (swapBytes(Order))
+                word = static_cast<quint16>((word << 8) | (word >> 8));
+            raw = static_cast<RawType>((static_cast<quint64>(raw) << 16) | word);
+        }
+
+        T value;
+        std::memcpy(&value, &raw, sizeof(T));
+        return value;
+    }
+
+    template <typename T, ByteOrder Order>
+    static int decodeBlock(const quint16 *registers, int registerCount, double *values)
+    {
+        const int words = sizeof(T) / 2;
+        int count = registerCount / words;
+        for (int i = 0; i < count; i++) {
+            values[i] = static_cast<double>(decodeValue<T, Order>(registers + i * words));
+        }
+        return count;
+    }
+
+    template <typename T, ByteOrder Order>
+    static void encodeValue(T value, quint16 *registers)
+    {
+        typedef typename Raw<sizeof(T)>::Type RawType;
+        const int words = sizeof(T) / 2;
+
+        RawType raw;
+        std::memcpy(&raw, &value, sizeof(T));
+        for (int i = words - 1; i >= 0; i--) {
+            quint16 word = static_cast<quint16>(raw & 0xffff);
+            if (swapBytes(Order))
+                word = static_cast<quint16>((word << 8) | (word >> 8));
+            registers[swapWords(Order) ? words - 1 - i : i] = word;
+            raw = static_cast<RawType>(static_cast<quint64>(raw) >> 16);
+        }
+    }
+
+private:
+    template <int Size> struct Raw;
+
+    static constexpr bool swapWords(ByteOrder order)
+    {
+        return order == ByteOrderCDAB || order == ByteOrderDCBA;
+    }
+
+    static constexpr bool swapBytes(ByteOrder order)
+    {
+        return order == ByteOrderBADC || order == ByteOrderDCBA;
+    }
+};
+
+template <> struct RegisterDecoder::Raw<2> { typedef quint16 Type; };
+template <> struct RegisterDecoder::Raw<4> { typedef quint32 Type; };
+template <> struct RegisterDecoder::Raw<8> { typedef quint64 Type; };
+
+#endif // REGISTERDECODER_H
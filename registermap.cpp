@@ -0,0 +1,204 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "registermap.h"
+#include "extern-plugininfo.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+
+RegisterMap::RegisterMap()
+{
+}
+
+bool RegisterMap::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_entries.clear();
+        qCDebug(dcModbusCommander()) << "Could not open register map" << fileName << file.errorString();
+        m_errorString = QString("Could not open the register map file");
+        return false;
+    }
+    return parse(file.readAll());
+}
+
+bool RegisterMap::parse(const QByteArray &data)
+{
+    m_entries.clear();
+    m_errorString.clear();
+
+    QByteArray trimmed = data.trimmed();
+    bool success = (trimmed.startsWith('[') || trimmed.startsWith('{')) ? parseJson(trimmed) : parseCsv(data);
+    if (!success)
+        m_entries.clear();
+
+    return success;
+}
+
+QList<RegisterMap::Entry> RegisterMap::entries() const
+{
+    return m_entries;
+}
+
+QString RegisterMap::errorString() const
+{
+    return m_errorString;
+}
+
+bool RegisterMap::parseCsv(const QByteArray &data)
+{
+    QList<QByteArray> lines = data.split('\n');
+    for (int i = 0; i < lines.count(); i++) {
+        QString line = QString::fromUtf8(lines.at(i)).trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        // Spreadsheets export with either separator
+        QStringList fields = line.split(line.contains(';') ? ';' : ',');
+        for (int j = 0; j < fields.count(); j++) {
+            fields[j] = fields.at(j).trimmed();
+            if (fields.at(j).length() >= 2 && fields.at(j).startsWith('"') && fields.at(j).endsWith('"'))
+                fields[j] = fields.at(j).mid(1, fields.at(j).length() - 2);
+        }
+
+        // Optional header line
+        if (m_entries.isEmpty() && fields.first().compare("name", Qt::CaseInsensitive) == 0)
+            continue;
+
+        if (fields.count() < 4) {
+            m_errorString = QString("Line %1: expected at least name, slave, type and address").arg(i + 1);
+            return false;
+        }
+
+        while (fields.count() < 7) {
+            fields.append(QString());
+        }
+        if (!addEntry(i + 1, fields.at(0), fields.at(1), fields.at(2), fields.at(3), fields.at(4), fields.at(5), fields.at(6)))
+            return false;
+    }
+    return true;
+}
+
+bool RegisterMap::parseJson(const QByteArray &data)
+{
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(data, &error);
+    if (error.error != QJsonParseError::NoError) {
+        m_errorString = QString("Invalid JSON at offset %1: %2").arg(error.offset).arg(error.errorString());
+        return false;
+    }
+
+    // Either the plain list of registers or an object holding it
+    QJsonArray registers = document.isArray() ? document.array() : document.object().value("registers").toArray();
+    for (int i = 0; i < registers.count(); i++) {
+        QJsonObject object = registers.at(i).toObject();
+        QStringList fields;
+        foreach (const QString &key, QStringList() << "name" << "slave" << "type" << "address" << "dataType" << "scale" << "pollInterval") {
+            QJsonValue value = object.value(key);
+            fields.append(value.isDouble() ? QString::number(value.toDouble(), 'g', 17) : value.toString());
+        }
+        if (!addEntry(i + 1, fields.at(0), fields.at(1), fields.at(2), fields.at(3), fields.at(4), fields.at(5), fields.at(6)))
+            return false;
+    }
+    return true;
+}
+
+bool RegisterMap::addEntry(int line, const QString &name, const QString &slaveAddress, const QString &registerType, const QString &registerAddress,
+                           const QString &dataType, const QString &scale, const QString &pollInterval)
+{
+    Entry entry;
+    entry.name = name;
+
+    bool ok = false;
+    entry.slaveAddress = slaveAddress.toUInt(&ok);
+    if (!ok || entry.slaveAddress < 1 || entry.slaveAddress > 247) {
+        qCDebug(dcModbusCommander()) << "Register map entry" << line << "has an invalid slave address:" << slaveAddress;
+        m_errorString = QString("Entry %1: invalid slave address").arg(line);
+        return false;
+    }
+
+    // "Holding register", "holdingRegister" and "holding_register" all name the same type
+    QString type = registerType.toLower().remove(' ').remove('_').remove('-');
+    if (type == "coil" || type == "coils") {
+        entry.registerType = QModbusDataUnit::RegisterType::Coils;
+    } else if (type == "discreteinput" || type == "discreteinputs") {
+        entry.registerType = QModbusDataUnit::RegisterType::DiscreteInputs;
+    } else if (type == "inputregister" || type == "inputregisters") {
+        entry.registerType = QModbusDataUnit::RegisterType::InputRegisters;
+    } else if (type == "holdingregister" || type == "holdingregisters") {
+        entry.registerType = QModbusDataUnit::RegisterType::HoldingRegisters;
+    } else {
+        qCDebug(dcModbusCommander()) << "Register map entry" << line << "has an unknown register type:" << registerType;
+        m_errorString = QString("Entry %1: unknown register type").arg(line);
+        return false;
+    }
+
+    entry.registerAddress = registerAddress.toUInt(&ok);
+    if (!ok || entry.registerAddress > 65535) {
+        qCDebug(dcModbusCommander()) << "Register map entry" << line << "has an invalid register address:" << registerAddress;
+        m_errorString = QString("Entry %1: invalid register address").arg(line);
+        return false;
+    }
+
+    if (!dataType.isEmpty()) {
+        bool known = false;
+        foreach (const QString &knownType, QStringList() << "UInt16" << "Int16" << "UInt32" << "Int32" << "Float32" << "Float64") {
+            if (dataType.compare(knownType, Qt::CaseInsensitive) == 0) {
+                entry.dataType = knownType;
+                known = true;
+            }
+        }
+        if (!known) {
+            qCDebug(dcModbusCommander()) << "Register map entry" << line << "has an unknown data type:" << dataType;
+            m_errorString = QString("Entry %1: unknown data type").arg(line);
+            return false;
+        }
+    }
+
+    if (!scale.isEmpty()) {
+        entry.scale = scale.toDouble(&ok);
+        if (!ok || entry.scale == 0) {
+            qCDebug(dcModbusCommander()) << "Register map entry" << line << "has an invalid scale:" << scale;
+            m_errorString = QString("Entry %1: invalid scale").arg(line);
+            return false;
+        }
+    }
+
+    if (!pollInterval.isEmpty()) {
+        entry.pollInterval = pollInterval.toUInt(&ok);
+        if (!ok) {
+            qCDebug(dcModbusCommander()) << "Register map entry" << line << "has an invalid poll interval:" << pollInterval;
+            m_errorString = QString("Entry %1: invalid poll interval").arg(line);
+            return false;
+        }
+    }
+
+    if (entry.name.isEmpty())
+        entry.name = QString("Slave %1 register %2").arg(entry.slaveAddress).arg(entry.registerAddress);
+
+    m_entries.append(entry);
+    return true;
+}
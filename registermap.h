@@ -0,0 +1,67 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef REGISTERMAP_H
+#define REGISTERMAP_H
+
+#include <QByteArray>
+#include <QList>
+#include <QModbusDataUnit>
+#include <QString>
+
+// A register map profile listing the points of one client device, either as CSV with the columns
+//   name, slave, type, address, data type, scale, poll interval
+// or as JSON array of objects with the keys name, slave, type, address, dataType, scale and pollInterval.
+// Only name, slave, type and address are required. The poll interval is in milliseconds, 0 or none
+// polls with the interval of the plugin.
+class RegisterMap
+{
+public:
+    struct Entry {
+        QString name;
+        uint slaveAddress = 1;
+        QModbusDataUnit::RegisterType registerType = QModbusDataUnit::Invalid;
+        uint registerAddress = 0;
+        QString dataType = "UInt16";
+        double scale = 1;
+        uint pollInterval = 0;
+    };
+
+    RegisterMap();
+
+    bool load(const QString &fileName);
+    bool parse(const QByteArray &data);
+
+    QList<Entry> entries() const;
+    QString errorString() const;
+
+private:
+    QList<Entry> m_entries;
+    QString m_errorString;
+
+    bool parseCsv(const QByteArray &data);
+    bool parseJson(const QByteArray &data);
+    bool addEntry(int line, const QString &name, const QString &slaveAddress, const QString &registerType, const QString &registerAddress,
+                  const QString &dataType, const QString &scale, const QString &pollInterval);
+};
+
+#endif // REGISTERMAP_H
@@ -0,0 +1,84 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "roundtripestimator.h"
+
+#include <QtMath>
+
+// Timer granularity, keeps the variance term from collapsing on very stable links
+static const double clockGranularity = 10;
+
+RoundTripEstimator::RoundTripEstimator(uint initialTimeout, uint minTimeout, uint maxTimeout) :
+    m_initialTimeout(initialTimeout),
+    m_minTimeout(minTimeout),
+    m_maxTimeout(maxTimeout)
+{
+}
+
+void RoundTripEstimator::setLimits(uint minTimeout, uint maxTimeout)
+{
+    m_minTimeout = minTimeout;
+    m_maxTimeout = qMax(minTimeout, maxTimeout);
+}
+
+uint RoundTripEstimator::timeout(uint slaveAddress) const
+{
+    Estimate estimate = m_estimates.value(slaveAddress);
+
+    double timeout = m_initialTimeout;
+    if (estimate.valid)
+        timeout = estimate.smoothedRoundTripTime + qMax(clockGranularity, 4 * estimate.roundTripTimeVariation);
+
+    timeout *= (1 << qMin(estimate.backoff, 16u));
+    return qBound(m_minTimeout, static_cast<uint>(qCeil(timeout)), m_maxTimeout);
+}
+
+uint RoundTripEstimator::smoothedRoundTripTime(uint slaveAddress) const
+{
+    return static_cast<uint>(m_estimates.value(slaveAddress).smoothedRoundTripTime);
+}
+
+void RoundTripEstimator::addSample(uint slaveAddress, uint roundTripTime)
+{
+    Estimate &estimate = m_estimates[slaveAddress];
+    if (!estimate.valid) {
+        estimate.smoothedRoundTripTime = roundTripTime;
+        estimate.roundTripTimeVariation = roundTripTime / 2.0;
+        estimate.valid = true;
+    } else {
+        estimate.roundTripTimeVariation = 0.75 * estimate.roundTripTimeVariation + 0.25 * qAbs(estimate.smoothedRoundTripTime - roundTripTime);
+        estimate.smoothedRoundTripTime = 0.875 * estimate.smoothedRoundTripTime + 0.125 * roundTripTime;
+    }
+    estimate.backoff = 0;
+}
+
+void RoundTripEstimator::addTimeout(uint slaveAddress)
+{
+    Estimate &estimate = m_estimates[slaveAddress];
+    if (timeout(slaveAddress) < m_maxTimeout)
+        estimate.backoff++;
+}
+
+void RoundTripEstimator::clear()
+{
+    m_estimates.clear();
+}
@@ -0,0 +1,58 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef ROUNDTRIPESTIMATOR_H
+#define ROUNDTRIPESTIMATOR_H
+
+#include <QHash>
+
+// Per slave response timeout estimation following RFC 6298 (SRTT/RTTVAR), the timeout of a slave
+// is doubled on every missed response until the next valid sample arrives
+class RoundTripEstimator
+{
+public:
+    explicit RoundTripEstimator(uint initialTimeout = 1000, uint minTimeout = 50, uint maxTimeout = 3000);
+
+    void setLimits(uint minTimeout, uint maxTimeout);
+
+    uint timeout(uint slaveAddress) const;
+    uint smoothedRoundTripTime(uint slaveAddress) const;
+
+    void addSample(uint slaveAddress, uint roundTripTime);
+    void addTimeout(uint slaveAddress);
+    void clear();
+
+private:
+    struct Estimate {
+        bool valid = false;
+        double smoothedRoundTripTime = 0;
+        double roundTripTimeVariation = 0;
+        uint backoff = 0;
+    };
+
+    uint m_initialTimeout;
+    uint m_minTimeout;
+    uint m_maxTimeout;
+    QHash<uint, Estimate> m_estimates;
+};
+
+#endif // ROUNDTRIPESTIMATOR_H
@@ -0,0 +1,88 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QtGlobal>
+#include <atomic>
+
+// Unbounded queue between exactly one producer and one consumer thread. Neither side ever
+// locks or waits for the other. The head node is a placeholder, so both sides only meet at
+// the atomic link of the last node.
+template <typename T>
+class SpscQueue
+{
+public:
+    SpscQueue() :
+        m_head(new Node()),
+        m_tail(m_head)
+    {
+    }
+
+    ~SpscQueue()
+    {
+        while (m_head) {
+            Node *next = m_head->next.load(std::memory_order_relaxed);
+            delete m_head;
+            m_head = next;
+        }
+    }
+
+    // Producer thread only
+    void enqueue(const T &value)
+    {
+        Node *node = new Node();
+        node->value = value;
+        // Publishes the value together with the node
+        m_tail->next.store(node, std::memory_order_release);
+        m_tail = node;
+    }
+
+    // Consumer thread only
+    bool dequeue(T *value)
+    {
+        Node *next = m_head->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+
+        // The node taken becomes the new placeholder
+        *value = next->value;
+        next->value = T();
+        delete m_head;
+        m_head = next;
+        return true;
+    }
+
+private:
+    struct Node {
+        T value = T();
+        std::atomic<Node *> next{nullptr};
+    };
+
+    Node *m_head;
+    Node *m_tail;
+
+    Q_DISABLE_COPY(SpscQueue)
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,139 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "startupsequencer.h"
+
+#include <QPair>
+#include <algorithm>
+
+StartupSequencer::StartupSequencer(QObject *parent) :
+    QObject(parent)
+{
+    m_timer = new QTimer(this);
+    m_timer->setInterval(WaveInterval);
+    connect(m_timer, &QTimer::timeout, this, &StartupSequencer::onTimeout);
+}
+
+uint StartupSequencer::ramp() const
+{
+    return m_ramp;
+}
+
+void StartupSequencer::setRamp(uint ramp)
+{
+    m_ramp = ramp;
+}
+
+void StartupSequencer::addPoint(QObject *master, Device *device, qint64 lastUpdate)
+{
+    removePoint(device);
+    m_waitingPoints.insert(device, master);
+    m_lastUpdates.insert(device, lastUpdate);
+
+    // Kept ordered by staleness, points never read before have no last update at all
+    QList<Device *> &waiting = m_sequences[master].waiting;
+    QList<Device *>::iterator position = std::upper_bound(waiting.begin(), waiting.end(), device, [this](Device *a, Device *b) {
+        return m_lastUpdates.value(a) < m_lastUpdates.value(b);
+    });
+    waiting.insert(position, device);
+    startWaves();
+}
+
+void StartupSequencer::removePoint(Device *device)
+{
+    QObject *master = m_waitingPoints.take(device);
+    m_lastUpdates.remove(device);
+    if (master)
+        m_sequences[master].waiting.removeAll(device);
+}
+
+void StartupSequencer::removeMaster(QObject *master)
+{
+    foreach (Device *device, m_sequences.take(master).waiting) {
+        m_waitingPoints.remove(device);
+        m_lastUpdates.remove(device);
+    }
+}
+
+bool StartupSequencer::isConnected(QObject *master) const
+{
+    return m_sequences.value(master).connected;
+}
+
+void StartupSequencer::setConnected(QObject *master, bool connected)
+{
+    Sequence &sequence = m_sequences[master];
+    sequence.connected = connected;
+    // Every connection starts its own ramp
+    sequence.waveSize = 0;
+    startWaves();
+}
+
+bool StartupSequencer::isWaiting(Device *device) const
+{
+    return m_waitingPoints.contains(device);
+}
+
+void StartupSequencer::startWaves()
+{
+    if (!m_timer->isActive())
+        m_timer->start();
+}
+
+void StartupSequencer::onTimeout()
+{
+    bool waiting = false;
+    QList<QPair<QObject *, QList<Device *> > > waves;
+    for (QHash<QObject *, Sequence>::iterator it = m_sequences.begin(); it != m_sequences.end(); ++it) {
+        Sequence &sequence = it.value();
+        if (!sequence.connected || sequence.waiting.isEmpty())
+            continue;
+
+        // The wave size is fixed by the points waiting when the ramp starts, points set up later join at the same rate
+        if (sequence.waveSize == 0) {
+            int waveCount = static_cast<int>(m_ramp / WaveInterval);
+            sequence.waveSize = waveCount > 0 ? (sequence.waiting.count() + waveCount - 1) / waveCount : sequence.waiting.count();
+        }
+
+        QList<Device *> devices = sequence.waiting.mid(0, sequence.waveSize);
+        sequence.waiting = sequence.waiting.mid(devices.count());
+        foreach (Device *device, devices) {
+            m_waitingPoints.remove(device);
+            m_lastUpdates.remove(device);
+        }
+        waves.append(qMakePair(it.key(), devices));
+
+        if (sequence.waiting.isEmpty()) {
+            sequence.waveSize = 0;
+        } else {
+            waiting = true;
+        }
+    }
+
+    if (!waiting)
+        m_timer->stop();
+
+    // Handlers may add or remove points, the sequences are left alone until then
+    for (int i = 0; i < waves.count(); i++) {
+        emit pointsDue(waves.at(i).first, waves.at(i).second);
+    }
+}
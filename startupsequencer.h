@@ -0,0 +1,77 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef STARTUPSEQUENCER_H
+#define STARTUPSEQUENCER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QTimer>
+
+class Device;
+
+// Brings newly set up points online. Nothing is read before their master is connected, then the
+// waiting points are released in waves spread over the ramp, so a restart with hundreds of points
+// doesn't flood the bus with first reads. Points with the oldest last update go first.
+class StartupSequencer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StartupSequencer(QObject *parent = nullptr);
+
+    uint ramp() const;
+    void setRamp(uint ramp);
+
+    void addPoint(QObject *master, Device *device, qint64 lastUpdate = 0);
+    void removePoint(Device *device);
+    void removeMaster(QObject *master);
+
+    bool isConnected(QObject *master) const;
+    void setConnected(QObject *master, bool connected);
+    bool isWaiting(Device *device) const;
+
+signals:
+    void pointsDue(QObject *master, const QList<Device *> &devices);
+
+private:
+    static const int WaveInterval = 250;
+
+    struct Sequence {
+        bool connected = false;
+        int waveSize = 0;
+        QList<Device *> waiting;
+    };
+
+    QTimer *m_timer = nullptr;
+    uint m_ramp = 10000;
+    QHash<QObject *, Sequence> m_sequences;
+    QHash<Device *, QObject *> m_waitingPoints;
+    QHash<Device *, qint64> m_lastUpdates;
+
+    void startWaves();
+
+private slots:
+    void onTimeout();
+};
+
+#endif // STARTUPSEQUENCER_H
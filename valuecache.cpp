@@ -0,0 +1,185 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "valuecache.h"
+#include "extern-plugininfo.h"
+
+#include <cstring>
+
+ValueCache::ValueCache()
+{
+}
+
+ValueCache::~ValueCache()
+{
+    close();
+}
+
+bool ValueCache::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qCWarning(dcModbusCommander()) << "Could not open value cache" << fileName << m_file.errorString();
+        return false;
+    }
+
+    // A file of another layout or cut short is started over, it only holds cached values
+    Header stored;
+    bool valid = m_file.size() >= static_cast<qint64>(sizeof(Header))
+            && m_file.read(reinterpret_cast<char *>(&stored), sizeof(Header)) == sizeof(Header)
+            && stored.magic == Magic && stored.version == Version && stored.slotCount > 0
+            && m_file.size() == static_cast<qint64>(sizeof(Header) + stored.slotCount * sizeof(Record));
+
+    if (!valid) {
+        if (m_file.size() > 0)
+            qCWarning(dcModbusCommander()) << "Discarding invalid value cache" << fileName;
+
+        if (!m_file.resize(0)) {
+            close();
+            return false;
+        }
+        stored.slotCount = InitialSlotCount;
+    }
+
+    if (!map(stored.slotCount)) {
+        close();
+        return false;
+    }
+
+    for (int slot = 0; slot < static_cast<int>(stored.slotCount); slot++) {
+        QUuid deviceId = QUuid::fromRfc4122(QByteArray::fromRawData(record(slot)->deviceId, 16));
+        if (deviceId.isNull()) {
+            m_freeSlots.append(slot);
+        } else {
+            m_slots.insert(deviceId, slot);
+        }
+    }
+    qCDebug(dcModbusCommander()) << "Restored" << m_slots.count() << "cached values from" << fileName;
+    return true;
+}
+
+void ValueCache::close()
+{
+    if (m_data)
+        m_file.unmap(m_data);
+
+    m_data = nullptr;
+    m_file.close();
+    m_slots.clear();
+    m_freeSlots.clear();
+}
+
+bool ValueCache::isOpen() const
+{
+    return m_data != nullptr;
+}
+
+bool ValueCache::value(const QUuid &deviceId, double *value, qint64 *timestamp) const
+{
+    if (!m_slots.contains(deviceId))
+        return false;
+
+    Record *cached = record(m_slots.value(deviceId));
+    *value = cached->value;
+    *timestamp = cached->timestamp;
+    return true;
+}
+
+void ValueCache::setValue(const QUuid &deviceId, double value, qint64 timestamp)
+{
+    if (!m_data)
+        return;
+
+    int slot = m_slots.value(deviceId, -1);
+    if (slot < 0) {
+        if (m_freeSlots.isEmpty() && !grow())
+            return;
+
+        slot = m_freeSlots.takeFirst();
+        m_slots.insert(deviceId, slot);
+        std::memcpy(record(slot)->deviceId, deviceId.toRfc4122().constData(), 16);
+    }
+
+    Record *cached = record(slot);
+    cached->value = value;
+    cached->timestamp = timestamp;
+}
+
+void ValueCache::remove(const QUuid &deviceId)
+{
+    if (!m_slots.contains(deviceId))
+        return;
+
+    int slot = m_slots.take(deviceId);
+    std::memset(record(slot), 0, sizeof(Record));
+    m_freeSlots.append(slot);
+}
+
+ValueCache::Header *ValueCache::header() const
+{
+    return reinterpret_cast<Header *>(m_data);
+}
+
+ValueCache::Record *ValueCache::record(int slot) const
+{
+    return reinterpret_cast<Record *>(m_data + sizeof(Header)) + slot;
+}
+
+bool ValueCache::map(quint32 slotCount)
+{
+    // Growing the file fills the new slots with zeros, which marks them free
+    qint64 size = static_cast<qint64>(sizeof(Header) + slotCount * sizeof(Record));
+    if (m_file.size() < size && !m_file.resize(size)) {
+        qCWarning(dcModbusCommander()) << "Could not resize value cache" << m_file.fileName() << m_file.errorString();
+        return false;
+    }
+
+    m_data = m_file.map(0, size);
+    if (!m_data) {
+        qCWarning(dcModbusCommander()) << "Could not map value cache" << m_file.fileName() << m_file.errorString();
+        return false;
+    }
+
+    header()->magic = Magic;
+    header()->version = Version;
+    header()->slotCount = slotCount;
+    header()->reserved = 0;
+    return true;
+}
+
+bool ValueCache::grow()
+{
+    quint32 slotCount = header()->slotCount;
+    m_file.unmap(m_data);
+    m_data = nullptr;
+    if (!map(slotCount * 2)) {
+        close();
+        return false;
+    }
+
+    for (int slot = static_cast<int>(slotCount); slot < static_cast<int>(slotCount * 2); slot++) {
+        m_freeSlots.append(slot);
+    }
+    return true;
+}
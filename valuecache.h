@@ -0,0 +1,78 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 Bernhard Trinnes <bernhard.trinnes@nymea.io>        *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef VALUECACHE_H
+#define VALUECACHE_H
+
+#include <QFile>
+#include <QHash>
+#include <QUuid>
+
+// Last known value and its time for every point, kept in a memory mapped file so a restart
+// can show plausible values right away. Every update is a plain store into the mapping,
+// the kernel writes the touched pages back on its own.
+class ValueCache
+{
+public:
+    ValueCache();
+    ~ValueCache();
+
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const;
+
+    // Timestamps are milliseconds since the epoch
+    bool value(const QUuid &deviceId, double *value, qint64 *timestamp) const;
+    void setValue(const QUuid &deviceId, double value, qint64 timestamp);
+    void remove(const QUuid &deviceId);
+
+private:
+    static const quint32 Magic = 0x4d425643;
+    static const quint32 Version = 1;
+    static const int InitialSlotCount = 64;
+
+    struct Header {
+        quint32 magic;
+        quint32 version;
+        quint32 slotCount;
+        quint32 reserved;
+    };
+
+    // A slot with a null device id is free
+    struct Record {
+        char deviceId[16];
+        qint64 timestamp;
+        double value;
+    };
+
+    QFile m_file;
+    uchar *m_data = nullptr;
+    QHash<QUuid, int> m_slots;
+    QList<int> m_freeSlots;
+
+    Header *header() const;
+    Record *record(int slot) const;
+    bool map(quint32 slotCount);
+    bool grow();
+};
+
+#endif // VALUECACHE_H